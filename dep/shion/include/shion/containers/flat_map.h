@@ -0,0 +1,218 @@
+#ifndef SHION_FLAT_MAP_H_
+#define SHION_FLAT_MAP_H_
+
+#include <bit>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "../types.h"
+
+namespace shion
+{
+  /*
+   * open addressing hash map with linear probing
+   * keys, values and slot states are kept in separate arrays, so probing only goes through the states and the keys
+   * erasing shifts the following entries of the probe sequence back instead of leaving tombstones,
+   * so lookups never slow down with churn ; the price is that pointers to values are invalidated by erase and by growth
+   *
+   * Key and T must be default constructible and move assignable, empty slots hold default constructed values
+   */
+  template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+  class flat_map
+  {
+  public:
+    using key_type = Key;
+    using mapped_type = T;
+    using size_type = size_t;
+
+    static constexpr inline size_t min_capacity = 16;
+
+    flat_map() = default;
+    flat_map(const flat_map &) = delete;
+    flat_map(flat_map &&other) noexcept :
+      _used{std::move(other._used)},
+      _keys{std::move(other._keys)},
+      _values{std::move(other._values)},
+      _capacity{std::exchange(other._capacity, 0)},
+      _size{std::exchange(other._size, 0)}
+    {
+    }
+
+    flat_map &operator=(const flat_map &) = delete;
+    flat_map &operator=(flat_map &&other) noexcept
+    {
+      _used = std::move(other._used);
+      _keys = std::move(other._keys);
+      _values = std::move(other._values);
+      _capacity = std::exchange(other._capacity, 0);
+      _size = std::exchange(other._size, 0);
+      return (*this);
+    }
+
+    size_t size() const noexcept
+    {
+      return (_size);
+    }
+
+    bool empty() const noexcept
+    {
+      return (_size == 0);
+    }
+
+    // number of slots, valid indices for the slot accessors are [0, capacity())
+    size_t capacity() const noexcept
+    {
+      return (_capacity);
+    }
+
+    bool occupied(size_t slot) const noexcept
+    {
+      return (_used[slot]);
+    }
+
+    const Key &key_at(size_t slot) const noexcept
+    {
+      return (_keys[slot]);
+    }
+
+    T &value_at(size_t slot) noexcept
+    {
+      return (_values[slot]);
+    }
+
+    const T &value_at(size_t slot) const noexcept
+    {
+      return (_values[slot]);
+    }
+
+    T *find(const Key &key) noexcept
+    {
+      if (size_t slot = _find(key); slot != npos)
+        return (&_values[slot]);
+      return (nullptr);
+    }
+
+    const T *find(const Key &key) const noexcept
+    {
+      if (size_t slot = _find(key); slot != npos)
+        return (&_values[slot]);
+      return (nullptr);
+    }
+
+    // returns the value for key, default constructing it if it was not there, and whether it was inserted
+    std::pair<T *, bool> try_emplace(const Key &key)
+    {
+      if (size_t slot = _find(key); slot != npos)
+        return {&_values[slot], false};
+      // keep the load factor under 3/4, past that linear probing sequences get long
+      if ((_size + 1) * 4 > _capacity * 3)
+        _grow();
+
+      size_t slot = _home(key);
+
+      while (_used[slot])
+        slot = (slot + 1) & _mask();
+      _used[slot] = true;
+      _keys[slot] = key;
+      ++_size;
+      return {&_values[slot], true};
+    }
+
+    bool erase(const Key &key)
+    {
+      if (size_t slot = _find(key); slot != npos)
+      {
+        erase_at(slot);
+        return (true);
+      }
+      return (false);
+    }
+
+    /*
+     * backward shift deletion : every entry after the hole that is not in its home slot and could live in the hole is moved into it,
+     * until an empty slot ends the probe sequence
+     * when iterating slots, the entry following an erased slot may have been moved into it and should be visited again
+     */
+    void erase_at(size_t slot)
+    {
+      size_t hole = slot;
+      size_t next = (hole + 1) & _mask();
+
+      while (_used[next])
+      {
+        size_t home = _home(_keys[next]);
+
+        // distance from home to hole is smaller than from home to next : the entry at next can move back into the hole
+        if (((hole - home) & _mask()) < ((next - home) & _mask()))
+        {
+          _keys[hole] = std::move(_keys[next]);
+          _values[hole] = std::move(_values[next]);
+          hole = next;
+        }
+        next = (next + 1) & _mask();
+      }
+      _used[hole] = false;
+      _keys[hole] = Key{};
+      _values[hole] = T{};
+      --_size;
+    }
+
+    void clear()
+    {
+      *this = flat_map{};
+    }
+
+  private:
+    static constexpr inline size_t npos = static_cast<size_t>(-1);
+
+    size_t _mask() const noexcept
+    {
+      return (_capacity - 1);
+    }
+
+    // fibonacci hashing, spreads hashes that are only distinct in a few bits, such as identity hashes of sequential integers
+    size_t _home(const Key &key) const noexcept
+    {
+      uint64 hash = static_cast<uint64>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+
+      return (static_cast<size_t>(hash >> (64 - std::countr_zero(_capacity))));
+    }
+
+    size_t _find(const Key &key) const noexcept
+    {
+      if (!_size)
+        return (npos);
+      for (size_t slot = _home(key); _used[slot]; slot = (slot + 1) & _mask())
+      {
+        if (KeyEqual{}(_keys[slot], key))
+          return (slot);
+      }
+      return (npos);
+    }
+
+    void _grow()
+    {
+      flat_map old = std::move(*this);
+
+      _capacity = old._capacity ? old._capacity * 2 : min_capacity;
+      _size = 0;
+      _used = std::make_unique<bool[]>(_capacity);
+      _keys = std::make_unique<Key[]>(_capacity);
+      _values = std::make_unique<T[]>(_capacity);
+      for (size_t i = 0; i < old._capacity; ++i)
+      {
+        if (old._used[i])
+          *try_emplace(old._keys[i]).first = std::move(old._values[i]);
+      }
+    }
+
+    std::unique_ptr<bool[]> _used;
+    std::unique_ptr<Key[]>  _keys;
+    std::unique_ptr<T[]>    _values;
+    size_t                  _capacity{0};
+    size_t                  _size{0};
+  };
+}
+
+#endif
@@ -156,15 +156,18 @@ namespace B12
 			static std::string url(ID identifier)
 			{
 				if constexpr (!shion::ends_with(BASE_URL, '/'))
-					return (fmt::format("{}/{}", BASE_URL.data, identifier));
+					return (fmt::format("{}/{}", BASE_URL.data, static_cast<uint64>(identifier)));
 				else
-					return (fmt::format("{}{}", BASE_URL.data, identifier));
+					return (fmt::format("{}{}", BASE_URL.data, static_cast<uint64>(identifier)));
 			}
 			
 			static std::string url(std::string_view identifier)
 				requires(CanUseName)
 			{
-				return (fmt::format("{}/{}", BASE_URL.data, identifier));
+				if constexpr (!shion::ends_with(BASE_URL, '/'))
+					return (fmt::format("{}/{}", BASE_URL.data, identifier));
+				else
+					return (fmt::format("{}{}", BASE_URL.data, identifier));
 			}
 			
 			static std::string url()
@@ -174,7 +177,7 @@ namespace B12
 			
 			static std::string resource(ID identifier)
 			{
-				return (fmt::format("{}/{}", Name.data, identifier));
+				return (fmt::format("{}/{}", Name.data, static_cast<uint64>(identifier)));
 			}
 			
 			static std::string resource(std::string_view identifier)
@@ -1,60 +1,258 @@
 #ifndef B12_API_CACHE_H_
 #define B12_API_CACHE_H_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <coroutine>
+#include <numeric>
+
 #include <shion/shion.h>
+#include <shion/containers/flat_map.h>
 
 #include "B12.h"
 #include "API.h"
 
 #include "CachedResource.h"
+#include "NameIndex.h"
+#include "ResourcePack.h"
 
 namespace B12
 {
+	enum class ResourceStorage
+	{
+		JSON, // one json file per resource
+		PACK  // a single CBOR pack file per endpoint, see ResourcePack
+	};
+
+	struct ResourceCacheConfig
+	{
+		// limits on what the cache keeps resident in memory, 0 means unlimited
+		// sizes are measured on the serialized resource, as received from the API
+		size_t max_entries = 0;
+		size_t max_bytes   = 0;
+
+		// serve expired resources right away and refresh them in the background
+		bool stale_while_revalidate = true;
+
+		// format of the resources saved on disk, only read on construction
+		// resources found in the json tree are moved to the pack when loaded
+		ResourceStorage storage = ResourceStorage::PACK;
+
+		// how long an ID or a name the API said does not exist is answered without asking again
+		std::chrono::seconds negative_ttl = std::chrono::minutes{10};
+
+		// circuit breaker : after this many upstream failures in a row, requests to the API are refused for a while,
+		// starting at backoff_min and doubling with every failed attempt up to backoff_max
+		uint32               failure_threshold = 5;
+		std::chrono::seconds backoff_min       = std::chrono::seconds{5};
+		std::chrono::seconds backoff_max       = std::chrono::minutes{10};
+	};
+
+	struct ResourceCacheStats
+	{
+		uint64 hits;
+		uint64 stale_hits;
+		uint64 misses;
+		uint64 evictions;
+		uint64 negative_hits;  // requests answered from the negative cache
+		uint64 short_circuits; // requests refused while the circuit breaker was open
+		uint64 fetched_bytes;  // downloaded from the API
+		size_t resident_entries;
+		size_t resident_bytes;
+	};
+
 	template <typename Endpoint>
 	struct ResourceCache;
 
 	template <template<typename, bool> typename EndpointT, shion::basic_string_literal Name, typename ID, bool CanUseName>
-	  requires (std::constructible_from<size_t, ID> && sizeof(ID) <= 2)
+	  requires (std::constructible_from<size_t, ID>)
 	struct ResourceCache<EndpointT<APIResource<Name, ID>, CanUseName>>
 	{
 		using Endpoint = EndpointT<APIResource<Name, ID>, CanUseName>;
 		using Resource = APIResource<Name, ID>;
 		
 		using resource_type = std::shared_ptr<Resource>;
-		using future_type = std::shared_future<resource_type>;
 
-		ResourceCache(size_t max_size) :
-			_max_entries(static_cast<ID>(std::min(max_size, size_t{std::numeric_limits<ID>::max()}))),
-			_storage(max_size)
+		// number of lock stripes, entries are assigned to a shard by their ID
+		static constexpr inline size_t SHARD_COUNT = 16;
+
+		// age after which a resource is refreshed from the API
+		static constexpr inline auto MAX_AGE = std::chrono::weeks{1};
+
+		// small IDs index a dense storage directly, wider ones (snowflakes, 32/64-bit IDs) go through a hash index in each shard
+		static constexpr inline bool DENSE_KEYS = (sizeof(ID) <= 2);
+
+		static constexpr inline size_t MAX_KEY = []() consteval
+		{
+			if constexpr (DENSE_KEYS)
+				return (size_t{std::numeric_limits<ID>::max()});
+			else
+				return (std::numeric_limits<size_t>::max());
+		}();
+
+		// the dense storage is allocated by chunks on first use, chunks are never moved until destruction
+		static constexpr inline size_t CHUNK_SIZE = 256;
+		static constexpr inline size_t CHUNK_COUNT = DENSE_KEYS ? (MAX_KEY + CHUNK_SIZE) / CHUNK_SIZE : 0;
+
+		// capacity is the whole range of ID until set
+		explicit ResourceCache(ResourceCacheConfig config) :
+			_capacity(MAX_KEY),
+			_max_resident_entries(config.max_entries),
+			_max_resident_bytes(config.max_bytes),
+			_stale_while_revalidate(config.stale_while_revalidate),
+			_negative_ttl(config.negative_ttl),
+			_failure_threshold(config.failure_threshold),
+			_backoff_min(config.backoff_min),
+			_backoff_max(config.backoff_max)
 		{
+			if (config.storage == ResourceStorage::PACK)
+				_use_pack = _pack.open(_packPath());
 			if constexpr (CanUseName)
-				_resolver.reserve(max_size);
+				_resolver.open(_namesPath());
+		}
+
+		ResourceCache(size_t max_size, ResourceCacheConfig config = {}) :
+			ResourceCache{config}
+		{
+			_setCapacity(max_size);
+		}
+
+		// does not block : starts with the last list of IDs known, and asks the API for it in the background if it is out of date
+		// wide keys are not contiguous, a list of them would not bound anything
+		ResourceCache(dpp::cluster *cluster, ResourceCacheConfig config = {}) :
+			ResourceCache{config}
+		{
+			if constexpr (DENSE_KEYS)
+			{
+				auto [ids, time] = _loadIds();
+
+				if (!ids.empty())
+					_setIds(std::move(ids));
+				if (_listedIds().empty() || std::chrono::file_clock::now() - time >= MAX_AGE)
+					_fetchIds(cluster);
+			}
 		}
 
-		ResourceCache(dpp::cluster *cluster) :
-			ResourceCache{_fetchCount(cluster)}
+		~ResourceCache()
 		{
+			for (std::atomic<Chunk *> &chunk : _chunks)
+				delete chunk.load(std::memory_order_acquire);
 		}
 		
+		// a load in flight, from disk or from the API, shared by everyone waiting on it ;
+		// waiters either block in wait() or are coroutines, resumed by complete() through the cluster's thread pool
+		// rather than on the thread completing the load, often one of dpp's request threads
+		class PendingLoad
+		{
+		public:
+			explicit PendingLoad(dpp::cluster *cluster) :
+				_cluster{cluster}
+			{
+			}
+
+			bool ready() const
+			{
+				std::scoped_lock lock{_mutex};
+
+				return (_done);
+			}
+
+			auto wait() -> resource_type
+			{
+				std::unique_lock lock{_mutex};
+
+				_cv.wait(lock, [this]() { return (_done); });
+				return (_result);
+			}
+
+			// returns false if the load completed in the meantime, in which case the coroutine must not suspend
+			bool await(std::coroutine_handle<> handle)
+			{
+				std::scoped_lock lock{_mutex};
+
+				if (_done)
+					return (false);
+				_waiters.push_back(handle);
+				return (true);
+			}
+
+			void complete(resource_type resource)
+			{
+				std::vector<std::coroutine_handle<>> waiters;
+
+				{
+					std::scoped_lock lock{_mutex};
+
+					_result = std::move(resource);
+					_done = true;
+					waiters.swap(_waiters);
+				}
+				_cv.notify_all();
+				for (std::coroutine_handle<> handle : waiters)
+					_cluster->queue_work(0, [handle]() { handle.resume(); });
+			}
+
+		private:
+			dpp::cluster                        *_cluster;
+			mutable std::mutex                   _mutex;
+			std::condition_variable              _cv;
+			std::vector<std::coroutine_handle<>> _waiters;
+			resource_type                        _result;
+			bool                                 _done = false;
+		};
+
+		using load_type = std::shared_ptr<PendingLoad>;
+
 		struct CachedResource
 		{
-				resource_type resource;
-				future_type   future;
-				app_time      last_touched;
-				file_time     time_retrieved;
+				CachedResource() = default;
+
+				// entries of wide keys are moved around by their index, always with the lock of their shard held
+				CachedResource(CachedResource &&other) noexcept :
+					resource(std::move(other.resource)),
+					load(std::move(other.load)),
+					last_touched(other.last_touched.load(std::memory_order_relaxed)),
+					time_retrieved(other.time_retrieved),
+					last_swept(other.last_swept),
+					missing_until(other.missing_until),
+					size(other.size)
+				{
+				}
+
+				CachedResource &operator=(CachedResource &&other) noexcept
+				{
+					resource = std::move(other.resource);
+					load = std::move(other.load);
+					last_touched.store(other.last_touched.load(std::memory_order_relaxed), std::memory_order_relaxed);
+					time_retrieved = other.time_retrieved;
+					last_swept = other.last_swept;
+					missing_until = other.missing_until;
+					size = other.size;
+					return (*this);
+				}
+
+				resource_type         resource;
+				load_type             load;
+				std::atomic<app_time> last_touched;
+				file_time             time_retrieved;
+				app_time              last_swept{}; // last time the eviction hand went past this entry
+				app_time              missing_until{}; // negative cache, the API said this ID does not exist
+				size_t                size = 0;
 		};
 
+		/*
+		 * a resource, or the load in flight that will produce it
+		 * get() blocks until the load completes ; in a coroutine, co_await the accessor instead,
+		 * the coroutine is then resumed on the cluster's thread pool once the load completes, without holding a thread in the meantime
+		 */
 		struct ResourceAccessor
 		{
-			auto get() -> const std::shared_ptr<Resource> &
+			auto get() -> const resource_type &
 			{
-				if (resource)
-					return (resource);
-				if (future.valid())
-				{
-					resource = future.get();
-					return (resource);
-				}
+				if (!resource && load)
+					resource = load->wait();
 				return (resource);
 			}
 
@@ -65,196 +263,986 @@ namespace B12
 
 			const Resource *operator->()
 			{
-				return (&get());
+				return (get().get());
 			}
 
-			~ResourceAccessor()
+			bool await_ready() const
 			{
-				const auto &resource = get();
+				return (resource || !load || load->ready());
+			}
 
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				return (load->await(handle));
+			}
+
+			auto await_resume() -> resource_type
+			{
+				return (get());
+			}
+
+			// does not wait for a load in flight
+			~ResourceAccessor()
+			{
 				if (resource)
 					cache._touch(resource->id);
-				
 			}
 			
 			ResourceCache&		 cache;
 			resource_type			 resource;
-			future_type				 future;
+			load_type				 load;
 		};
 		
-		using Storage = std::vector<CachedResource>;
-		
+		// size of the ID space, once known
+		auto capacity() const -> std::optional<size_t>
+		{
+			if (!_bounded.load(std::memory_order_relaxed))
+				return {std::nullopt};
+			return {_capacity.load(std::memory_order_relaxed)};
+		}
+
+		// the IDs the API lists, in order ; they can be sparse, PokeAPI lists alternate forms from 10001
+		// without a list, every ID from 1 below the capacity, or nothing until the capacity is known
+		auto ids() const -> std::vector<size_t>
+		{
+			std::vector<size_t> ids = _listedIds();
+
+			if (ids.empty())
+			{
+				if (auto size = capacity(); size && *size > 1)
+				{
+					ids.resize(*size - 1);
+					std::iota(ids.begin(), ids.end(), size_t{1});
+				}
+			}
+			return (ids);
+		}
+
+		// false while the circuit breaker holds requests
+		bool isUpstreamAvailable() const
+		{
+			if (_consecutive_failures.load(std::memory_order_relaxed) < _failure_threshold.load(std::memory_order_relaxed))
+				return (true);
+			return (std::chrono::steady_clock::now() >= _breaker_open_until.load(std::memory_order_relaxed));
+		}
+
+		static auto prefetchPath() -> std::filesystem::path
+		{
+			std::filesystem::path prefetch_path = shion::literal_concat(Endpoint::API_t::NAME, "/", Name, ".prefetch").data;
+
+			return (prefetch_path.lexically_normal());
+		}
+
 		bool isKeyValid(ID value) const
 		{
-			if (!(value < _max_entries))
+			if constexpr (!DENSE_KEYS)
+				return (true);
+			if (!(static_cast<size_t>(value) < _capacity.load(std::memory_order_relaxed)))
 				return (false);
 			return (true);
 		}
+
+		void configure(ResourceCacheConfig config)
+		{
+			_max_resident_entries.store(config.max_entries, std::memory_order_relaxed);
+			_max_resident_bytes.store(config.max_bytes, std::memory_order_relaxed);
+			_stale_while_revalidate.store(config.stale_while_revalidate, std::memory_order_relaxed);
+			_negative_ttl.store(config.negative_ttl, std::memory_order_relaxed);
+			_failure_threshold.store(config.failure_threshold, std::memory_order_relaxed);
+			_backoff_min.store(config.backoff_min, std::memory_order_relaxed);
+			_backoff_max.store(config.backoff_max, std::memory_order_relaxed);
+			_enforceBudget();
+		}
+
+		auto stats() const -> ResourceCacheStats
+		{
+			return {
+				_hits.load(std::memory_order_relaxed),
+				_stale_hits.load(std::memory_order_relaxed),
+				_misses.load(std::memory_order_relaxed),
+				_evictions.load(std::memory_order_relaxed),
+				_negative_hits.load(std::memory_order_relaxed),
+				_short_circuits.load(std::memory_order_relaxed),
+				_fetched_bytes.load(std::memory_order_relaxed),
+				_resident_entries.load(std::memory_order_relaxed),
+				_resident_bytes.load(std::memory_order_relaxed)
+			};
+		}
 		
+		/*
+		 * every load of an entry, from disk or from the API, goes through the entry's pending load :
+		 * the first caller to miss creates it and does the work, concurrent callers wait on it
+		 */
 		auto request(dpp::cluster *cluster, ID id) -> ResourceAccessor
 		{
 			if (!isKeyValid(id)) // for now, until i come up with a good solution
 				return {*this, nullptr, {}};
 			
-			std::scoped_lock lock{_mutex};
+			Shard &shard = _shard(id);
 			auto fstime_now = std::chrono::file_clock::now();
-			CachedResource *entry = _fetch(id);
+			bool revalidate = _stale_while_revalidate.load(std::memory_order_relaxed);
+			load_type load;
+			resource_type stale;
 
-			if (entry)
 			{
-				if (entry->resource && fstime_now - entry->time_retrieved < std::chrono::weeks{1})
-					return (make_accessor(*entry));
-				if (entry->future.valid())
-					return (make_accessor(*entry));
+				std::scoped_lock lock{shard.mutex};
+				CachedResource &entry = _retrieve(shard, id);
+
+				if (entry.resource && fstime_now - entry.time_retrieved < MAX_AGE)
+				{
+					_hits.fetch_add(1, std::memory_order_relaxed);
+					return (make_accessor(entry));
+				}
+				if (entry.resource && revalidate)
+				{
+					_stale_hits.fetch_add(1, std::memory_order_relaxed);
+					if (entry.load) // already being refreshed
+						return (make_accessor(entry));
+					stale = entry.resource;
+				}
+				else if (entry.load)
+					return (make_waiter(entry));
+				else if (std::chrono::steady_clock::now() < entry.missing_until)
+				{
+					_negative_hits.fetch_add(1, std::memory_order_relaxed);
+					return {*this, nullptr, {}};
+				}
+				else
+					_misses.fetch_add(1, std::memory_order_relaxed);
+				load = _beginLoad(entry, cluster);
+				entry.last_touched.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
 			}
 
-			// otherwise, first try to get saved files
-			namespace fs = std::filesystem;
-			
-			fs::path cache_path = shion::literal_concat(Endpoint::API_t::NAME, "/", Name).data;
-			std::error_code err;
+			if (stale)
+			{
+				_requestRemote(cluster, id, std::move(load));
+				return {*this, std::move(stale), {}};
+			}
 
-			cache_path /= fmt::format("{}.json", id);
-			cache_path = cache_path.lexically_normal();
-			if (auto time = fs::last_write_time(cache_path, err);
-					err == std::error_code{} && fstime_now - time < std::chrono::weeks{1})
+			// we own the load, first try to get saved files ; the disk read and the parsing are done without holding the lock
+			if (auto [resource, size, time] = _load(id); resource && (revalidate || fstime_now - time < MAX_AGE))
 			{
-				if (std::ifstream fs{cache_path}; fs.good())
+				load_type refresh;
+
+				_learnName(*resource);
 				{
-					entry->resource = std::make_shared<Resource>(Resource{.resource = json::parse(fs)});
-					entry->time_retrieved = fstime_now;
-					return (make_accessor(*entry));
+					std::scoped_lock lock{shard.mutex};
+					CachedResource &entry = _retrieve(shard, id);
+
+					_install(entry, resource, size);
+					entry.time_retrieved = time;
+					entry.load = nullptr;
+					if (fstime_now - time >= MAX_AGE)
+						refresh = _beginLoad(entry, cluster);
 				}
+				load->complete(resource);
+				if (refresh)
+					_requestRemote(cluster, id, std::move(refresh));
+				_enforceBudget();
+				return {*this, std::move(resource), {}};
+			}
+
+			_requestRemote(cluster, id, load);
+			return {*this, nullptr, std::move(load)};
+		}
+
+		// for warming up the cache : loads the resource unless it is in memory, being loaded, known to be missing,
+		// or saved on disk and up to date. returns an accessor on the load if one was started
+		auto prefetch(dpp::cluster *cluster, ID id) -> std::optional<ResourceAccessor>
+		{
+			if (!isKeyValid(id))
+				return {std::nullopt};
+
+			auto fstime_now = std::chrono::file_clock::now();
+
+			{
+				Shard &shard = _shard(id);
+				std::scoped_lock lock{shard.mutex};
+				CachedResource &entry = _retrieve(shard, id);
+
+				if (entry.load || std::chrono::steady_clock::now() < entry.missing_until ||
+				    (entry.resource && fstime_now - entry.time_retrieved < MAX_AGE))
+					return {std::nullopt};
+			}
+			if (auto time = _storedTime(id); time && fstime_now - *time < MAX_AGE)
+				return {std::nullopt};
+			return {request(cluster, id)};
+		}
+
+		// names already seen are resolved locally, unknown ones are asked to the API and learned from the response
+		auto request(dpp::cluster *cluster, std::string_view name) -> ResourceAccessor
+			requires (CanUseName)
+		{
+			if (auto id = _resolver.find(name); id)
+				return (request(cluster, static_cast<ID>(*id)));
+
+			std::string normalized = NameIndex::normalize(name);
+
+			if (normalized.empty())
+				return {*this, nullptr, {}};
+			if (_isMissingName(normalized))
+			{
+				_negative_hits.fetch_add(1, std::memory_order_relaxed);
+				return {*this, nullptr, {}};
 			}
-			auto promise = new std::promise<std::shared_ptr<Resource>>{};
-			entry->future = promise->get_future().share();
-			cluster->request(Endpoint::url(id), dpp::m_get, OnRecv{std::move(promise), id, this});
-			return (make_accessor(*entry));
+
+			load_type load;
+
+			{
+				// like IDs, concurrent misses on a name wait on the first one's request
+				std::scoped_lock lock{_pending_names_mutex};
+
+				if (auto it = _pending_names.find(normalized); it != _pending_names.end())
+					return {*this, nullptr, it->second};
+				if (!_allowRemote())
+					return {*this, nullptr, {}};
+				load = std::make_shared<PendingLoad>(cluster);
+				_pending_names.try_emplace(normalized, load);
+			}
+
+			std::string url = Endpoint::url(std::string_view{normalized});
+
+			_misses.fetch_add(1, std::memory_order_relaxed);
+			cluster->request(url, dpp::m_get, OnRecv{load, std::nullopt, this, std::move(normalized)});
+			return {*this, nullptr, std::move(load)};
+		}
+
+		auto resolve(std::string_view name) const -> std::optional<ID>
+			requires (CanUseName)
+		{
+			if (auto id = _resolver.find(name); id)
+				return {static_cast<ID>(*id)};
+			return {std::nullopt};
+		}
+
+		// closest names known, best first, to resolve typos or complete a partial name
+		auto suggest(std::string_view query, size_t max_results) const -> std::vector<NameIndex::Match>
+			requires (CanUseName)
+		{
+			return (_resolver.search(query, max_results));
 		}
 
 	private:
+		struct KeyHash
+		{
+			size_t operator()(const ID &id) const noexcept
+			{
+				return (static_cast<size_t>(id));
+			}
+		};
+
+		using WideIndex = std::conditional_t<DENSE_KEYS, empty_t, shion::flat_map<ID, CachedResource, KeyHash>>;
+
+		struct Shard
+		{
+			std::mutex mutex;
+			WideIndex  index;          // wide keys only
+			size_t     clock_hand = 0; // wide keys only, slot of the index the eviction hand is at
+		};
+
+		using Chunk = std::array<CachedResource, CHUNK_SIZE>;
+
 		struct OnRecv
 		{
-			std::promise<std::shared_ptr<Resource>> *p;
+			load_type load;
 			std::optional<ID> id;
 			ResourceCache *self;
+			std::string name{}; // set when requesting by name
 
 			void operator()(const dpp::http_request_completion_t &result)
 			{
-				std::scoped_lock lock{self->_mutex};
-				
-				if (result.error || result.status >= 300)
+				json value = json::value_t::discarded;
+				// any other client error is on our side, not the API's
+				bool missing = !result.error && (result.status == 404 || result.status == 410);
+
+				if (!result.error && result.status < 300)
+					value = json::parse(result.body, nullptr, false);
+				if (value.is_discarded())
 				{
-					static_assert(!std::is_const_v<decltype(p)>);
-					p->set_value(nullptr);
-					delete p;
+					if (missing)
+						self->_recordSuccess();
+					else
+						self->_recordFailure();
+					// a stale resource, if any, stays in place ; the next request will retry
+					if (id.has_value())
+					{
+						Shard &shard = self->_shard(*id);
+						std::scoped_lock lock{shard.mutex};
+
+						self->_cancelLoad(shard, *id, missing);
+					}
+					else if (missing && !name.empty())
+						self->_addMissingName(name);
+					if (!name.empty())
+						self->_endNameLoad(name);
+					load->complete(nullptr);
 					return;
 				}
-				auto json = json::parse(result.body);
+				self->_recordSuccess();
+				self->_fetched_bytes.fetch_add(result.body.size(), std::memory_order_relaxed);
 				
 				if (!id.has_value())
-					id = resource_id<Resource>(json);
+					id = resource_id<Resource>(value);
 
-				std::shared_ptr<Resource> ptr = std::make_shared<Resource>(Resource{.resource = std::move(json), .id = id.value_or(std::numeric_limits<ID>::max())});
+				std::shared_ptr<Resource> ptr = std::make_shared<Resource>(Resource{.resource = std::move(value), .id = id.value_or(no_resource_id<ID>())});
 				
 				if (id.has_value())
 				{
-					std::error_code err;
-					std::filesystem::path file_path{Endpoint::resource(*id)};
-				
-					if (auto parent_path = file_path.parent_path();
-							create_directories(parent_path, err) || err == std::error_code{})
+					self->_save(*id, ptr->resource, result.body);
+					self->_learnName(*ptr);
+
+					Shard &shard = self->_shard(*id);
 					{
-						std::ofstream fs{file_path, std::ios::out | std::ios::trunc};
+						std::scoped_lock lock{shard.mutex};
+						CachedResource &entry = self->_retrieve(shard, *id);
 
-						if (fs.good())
-							fs << json.dump();
-						else
-							B12::log(LogLevel::ERROR, "Failed to save API resource {}:{} to disk", Endpoint::PATH.data, id.value_or(0));
+						self->_install(entry, ptr, result.body.size());
+						if (entry.load == load) // a request by name may have raced with one by ID
+							entry.load = nullptr;
+						entry.last_touched.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+						entry.time_retrieved = std::chrono::file_clock::now();
 					}
-					else
-						B12::log(LogLevel::ERROR, "Failed to create directories for path {}", parent_path.string());
+					self->_enforceBudget();
 				}
-				
-				if (id.has_value())
-					self->_retrieve(*id) = CachedResource{ptr, {}, std::chrono::steady_clock::now(), std::chrono::file_clock::now()};
-				p->set_value(ptr);
-				delete p;
+				// the name is learned by now, requests from here on resolve it locally
+				if (!name.empty())
+					self->_endNameLoad(name);
+				load->complete(ptr);
 			}
 		};
 
-		auto _fetchCount(dpp::cluster *cluster) -> ID
+		static auto _idsPath() -> std::filesystem::path
 		{
+			std::filesystem::path ids_path = shion::literal_concat(Endpoint::API_t::NAME, "/", Name, ".ids").data;
+
+			return (ids_path.lexically_normal());
+		}
+
+		auto _loadIds() -> std::pair<std::vector<size_t>, file_time>
+		{
+			std::filesystem::path ids_path = _idsPath();
+			std::error_code err;
+			std::vector<size_t> ids;
 
-			auto future = Endpoint::retrieve_json(cluster);
-			auto value = future.get();
-			if (std::holds_alternative<json>(value))
+			if (auto time = std::filesystem::last_write_time(ids_path, err); err == std::error_code{})
 			{
-				const json &json_value = std::get<json>(value);
-				
-				if (auto it = json_value.find("count"); it != json_value.end() && it->is_number_integer())
+				if (std::ifstream fs{ids_path}; fs.good())
 				{
-					size_t size = it->get<size_t>();
-					
-					B12::log(LogLevel::TRACE, "Loaded count for API {} : {} entries", Endpoint::PATH, size);
-					if (size > std::numeric_limits<ID>::max())
-						log(LogLevel::ERROR, "Fetched count for API {} is larger than this cache is set to hold", size);
-					return (static_cast<ID>(size));
+					for (size_t id; fs >> id;)
+						ids.push_back(id);
+					return {std::move(ids), time};
 				}
-				B12::log(LogLevel::TRACE, "Could not find count for API {}", Endpoint::PATH);
+			}
+			return {std::move(ids), {}};
+		}
+
+		void _saveIds(const std::vector<size_t> &ids)
+		{
+			std::filesystem::path ids_path = _idsPath();
+			std::error_code err;
+
+			if (auto parent_path = ids_path.parent_path();
+					create_directories(parent_path, err) || err == std::error_code{})
+			{
+				if (std::ofstream fs{ids_path, std::ios::out | std::ios::trunc}; fs.good())
+				{
+					for (size_t id : ids)
+						fs << id << '\n';
+				}
+				else
+					B12::log(LogLevel::ERROR, "Failed to save the IDs of API {}", Endpoint::PATH);
 			}
 			else
-				B12::log(LogLevel::TRACE, "Error while fetching count for API {}", Endpoint::PATH);
-			return (0);
+				B12::log(LogLevel::ERROR, "Failed to create directories for path {}", parent_path.string());
+		}
+
+		// the list of the endpoint in a single page, the URL of each entry ends with its ID
+		void _fetchIds(dpp::cluster *cluster)
+		{
+			cluster->request(fmt::format("{}?limit={}", Endpoint::url(), MAX_KEY), dpp::m_get, [this](const dpp::http_request_completion_t &result)
+			{
+				if (result.error || result.status >= 300)
+				{
+					B12::log(LogLevel::TRACE, "Error while fetching the IDs of API {}", Endpoint::PATH);
+					return;
+				}
+
+				json value = json::parse(result.body, nullptr, false);
+				std::vector<size_t> ids;
+
+				if (auto it = value.find("results"); !value.is_discarded() && it != value.end() && it->is_array())
+				{
+					for (const json &entry : *it)
+					{
+						if (auto id = _listedId(entry); id)
+							ids.push_back(*id);
+					}
+				}
+				if (ids.empty())
+				{
+					B12::log(LogLevel::TRACE, "Could not find the IDs of API {}", Endpoint::PATH);
+					return;
+				}
+				B12::log(LogLevel::TRACE, "Loaded the IDs of API {} : {} entries", Endpoint::PATH, ids.size());
+				_setIds(std::move(ids));
+				_saveIds(_listedIds());
+			});
+		}
+
+		static auto _listedId(const json &entry) -> std::optional<size_t>
+		{
+			auto it = entry.find("url");
+
+			if (it == entry.end() || !it->is_string())
+				return {std::nullopt};
+
+			std::string_view url = it->get_ref<const std::string &>();
+			size_t id = 0;
+
+			while (!url.empty() && url.back() == '/')
+				url.remove_suffix(1);
+			url = url.substr(url.rfind('/') + 1);
+			if (auto [end, err] = std::from_chars(url.data(), url.data() + url.size(), id); err != std::errc{} || end != url.data() + url.size())
+				return {std::nullopt};
+			return {id};
+		}
+
+		// the capacity covers the highest ID listed
+		void _setIds(std::vector<size_t> ids)
+		{
+			std::ranges::sort(ids);
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			_setCapacity(ids.back() + 1);
+
+			std::scoped_lock lock{_ids_mutex};
+
+			_ids = std::move(ids);
+		}
+
+		auto _listedIds() const -> std::vector<size_t>
+		{
+			std::scoped_lock lock{_ids_mutex};
+
+			return (_ids);
+		}
+
+		void _setCapacity(size_t size)
+		{
+			if (size > MAX_KEY)
+			{
+				log(LogLevel::ERROR, "Fetched count for API {} is larger than this cache is set to hold", size);
+				size = MAX_KEY;
+			}
+			_capacity.store(size, std::memory_order_relaxed);
+			_bounded.store(true, std::memory_order_relaxed);
 		}
 		
 		void _touch(ID id)
 		{
-			std::scoped_lock lock{_mutex};
-			CachedResource *entry = _fetch(id);
+			if constexpr (DENSE_KEYS)
+			{
+				// entries are never moved, no need to lock anything
+				if (CachedResource *entry = _fetch(id); entry)
+				{
+					entry->last_touched.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+					return;
+				}
+				B12::log(LogLevel::ERROR, "Could not find entry {}:{} for update", Endpoint::PATH.data, static_cast<uint64>(id));
+			}
+			else
+			{
+				// the entry may have been evicted since, in which case there is nothing to update
+				Shard &shard = _shard(id);
+				std::scoped_lock lock{shard.mutex};
+
+				if (CachedResource *entry = shard.index.find(id); entry)
+					entry->last_touched.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+			}
+		}
+
+		static auto _cachePath(ID id) -> std::filesystem::path
+		{
+			std::filesystem::path cache_path = shion::literal_concat(Endpoint::API_t::NAME, "/", Name).data;
+
+			// IDs are formatted as integers, a class ID may not have a formatter
+			cache_path /= fmt::format("{}.json", static_cast<uint64>(id));
+			return (cache_path.lexically_normal());
+		}
+
+		static auto _namesPath() -> std::filesystem::path
+		{
+			std::filesystem::path names_path = shion::literal_concat(Endpoint::API_t::NAME, "/", Name, ".names").data;
+
+			return (names_path.lexically_normal());
+		}
+
+		void _learnName(const Resource &resource)
+		{
+			if constexpr (CanUseName)
+			{
+				if (std::string_view name = resource_name<Resource>(resource.resource); !name.empty())
+					_resolver.insert(name, static_cast<uint64>(resource.id));
+			}
+		}
+
+		struct DiskResource
+		{
+			resource_type resource;
+			size_t        size;
+			file_time     time;
+		};
+
+		static auto _packPath() -> std::filesystem::path
+		{
+			std::filesystem::path pack_path = shion::literal_concat(Endpoint::API_t::NAME, "/", Name, ".pack").data;
 
-			if (!entry)
+			return (pack_path.lexically_normal());
+		}
+
+		auto _load(ID id) -> DiskResource
+		{
+			if (_use_pack)
 			{
-				B12::log(LogLevel::ERROR, "Could not find entry {}:{} for update", Endpoint::PATH.data, id);
+				if (auto record = _pack.load(id); record)
+					return {std::make_shared<Resource>(Resource{.resource = std::move(record->value), .id = id}), record->size, record->time};
+			}
+
+			std::filesystem::path cache_path = _cachePath(id);
+			std::error_code err;
+
+			if (auto time = std::filesystem::last_write_time(cache_path, err); err == std::error_code{})
+			{
+				if (std::ifstream fs{cache_path}; fs.good())
+				{
+					std::string content{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+
+					fs.close();
+					if (auto value = json::parse(content, nullptr, false); !value.is_discarded())
+					{
+						// migrate from the json tree
+						if (_use_pack && _pack.store(id, value, time))
+							std::filesystem::remove(cache_path, err);
+						return {std::make_shared<Resource>(Resource{.resource = std::move(value), .id = id}), content.size(), time};
+					}
+					B12::log(LogLevel::ERROR, "Failed to parse API resource {}", cache_path.string());
+				}
+			}
+			return {nullptr, 0, {}};
+		}
+
+		// time the resource was saved on disk, without reading it
+		auto _storedTime(ID id) -> std::optional<file_time>
+		{
+			std::error_code err;
+
+			if (_use_pack)
+			{
+				if (auto time = _pack.time(id); time)
+					return (time);
+			}
+			if (auto time = std::filesystem::last_write_time(_cachePath(id), err); err == std::error_code{})
+				return {time};
+			return {std::nullopt};
+		}
+
+		// must be called with the lock of the entry's shard held
+		auto _beginLoad(CachedResource &entry, dpp::cluster *cluster) -> load_type
+		{
+			entry.load = std::make_shared<PendingLoad>(cluster);
+			return (entry.load);
+		}
+
+		void _requestRemote(dpp::cluster *cluster, ID id, load_type load)
+		{
+			if (!_allowRemote())
+			{
+				{
+					Shard &shard = _shard(id);
+					std::scoped_lock lock{shard.mutex};
+
+					_cancelLoad(shard, id, false);
+				}
+				load->complete(nullptr);
 				return;
 			}
-			entry->last_touched = std::chrono::steady_clock::now();
+			cluster->request(Endpoint::url(id), dpp::m_get, OnRecv{std::move(load), id, this});
 		}
 
-		void _save(json json)
+		// circuit breaker : closed until failure_threshold failures in a row, then open for a backoff that doubles every failure ;
+		// once the backoff is over, a single request goes through as a probe, and its result closes the breaker or opens it again
+		bool _allowRemote()
 		{
-			
+			if (_consecutive_failures.load(std::memory_order_relaxed) < _failure_threshold.load(std::memory_order_relaxed))
+				return (true);
+
+			app_time now = std::chrono::steady_clock::now();
+			app_time until = _breaker_open_until.load(std::memory_order_relaxed);
+
+			if (now >= until && _breaker_open_until.compare_exchange_strong(until, now + _backoff(), std::memory_order_relaxed))
+				return (true);
+			_short_circuits.fetch_add(1, std::memory_order_relaxed);
+			return (false);
+		}
+
+		auto _backoff() const -> std::chrono::seconds
+		{
+			uint32 failures = _consecutive_failures.load(std::memory_order_relaxed);
+			uint32 threshold = _failure_threshold.load(std::memory_order_relaxed);
+			std::chrono::seconds max = _backoff_max.load(std::memory_order_relaxed);
+			std::chrono::seconds backoff = _backoff_min.load(std::memory_order_relaxed);
+
+			for (uint32 i = threshold; i < failures && backoff < max; ++i)
+				backoff *= 2;
+			return (std::min(backoff, max));
+		}
+
+		void _recordSuccess()
+		{
+			if (_consecutive_failures.exchange(0, std::memory_order_relaxed) >= _failure_threshold.load(std::memory_order_relaxed))
+				B12::log(LogLevel::INFO, "API {} is reachable again", Endpoint::PATH.data);
+			_breaker_open_until.store({}, std::memory_order_relaxed);
+		}
+
+		void _recordFailure()
+		{
+			uint32 failures = _consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+
+			if (failures >= _failure_threshold.load(std::memory_order_relaxed))
+			{
+				auto backoff = _backoff();
+
+				_breaker_open_until.store(std::chrono::steady_clock::now() + backoff, std::memory_order_relaxed);
+				B12::log(LogLevel::ERROR, "API {} failed {} times in a row, holding requests for {}s", Endpoint::PATH.data, failures, backoff.count());
+			}
+		}
+
+		bool _isMissingName(const std::string &name)
+			requires (CanUseName)
+		{
+			std::scoped_lock lock{_missing_names_mutex};
+
+			if (auto it = _missing_names.find(name); it != _missing_names.end())
+			{
+				if (std::chrono::steady_clock::now() < it->second)
+					return (true);
+				_missing_names.erase(it);
+			}
+			return (false);
+		}
+
+		void _addMissingName(std::string name)
+		{
+			if constexpr (CanUseName)
+			{
+				app_time now = std::chrono::steady_clock::now();
+				std::scoped_lock lock{_missing_names_mutex};
+
+				if (_missing_names.size() >= MAX_MISSING_NAMES)
+					std::erase_if(_missing_names, [now](const auto &entry) { return (entry.second <= now); });
+				if (_missing_names.size() < MAX_MISSING_NAMES)
+					_missing_names.insert_or_assign(std::move(name), now + _negative_ttl.load(std::memory_order_relaxed));
+			}
+		}
+
+		void _endNameLoad(const std::string &name)
+		{
+			if constexpr (CanUseName)
+			{
+				std::scoped_lock lock{_pending_names_mutex};
+
+				_pending_names.erase(name);
+			}
+		}
+
+		void _save(ID id, const json &value, std::string_view body)
+		{
+			if (_use_pack && _pack.store(id, value, std::chrono::file_clock::now()))
+				return;
+
+			std::error_code err;
+			std::filesystem::path file_path = _cachePath(id);
+		
+			if (auto parent_path = file_path.parent_path();
+					create_directories(parent_path, err) || err == std::error_code{})
+			{
+				std::ofstream fs{file_path, std::ios::out | std::ios::trunc};
+
+				if (fs.good())
+					fs << body;
+				else
+					B12::log(LogLevel::ERROR, "Failed to save API resource {}:{} to disk", Endpoint::PATH.data, static_cast<uint64>(id));
+			}
+			else
+				B12::log(LogLevel::ERROR, "Failed to create directories for path {}", parent_path.string());
 		}
 
 		template <typename... Ts>
 		auto make_accessor(CachedResource &resource) -> ResourceAccessor
 		{
-			resource.last_touched = std::chrono::steady_clock::now();
-			return {*this, resource.resource, resource.future};
+			resource.last_touched.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+			return {*this, resource.resource, resource.load};
+		}
+
+		// accessor on the load in flight, ignoring a resource that might be there but is out of date
+		auto make_waiter(CachedResource &resource) -> ResourceAccessor
+		{
+			resource.last_touched.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+			return {*this, nullptr, resource.load};
+		}
+
+		// a load failed, missing if the API said the resource does not exist
+		// must be called with the lock of the entry's shard held
+		void _cancelLoad(Shard &shard, ID id, bool missing)
+		{
+			CachedResource &entry = _retrieve(shard, id);
+
+			entry.load = nullptr;
+			if (missing)
+			{
+				entry.missing_until = std::chrono::steady_clock::now() + _negative_ttl.load(std::memory_order_relaxed);
+				return;
+			}
+			if constexpr (!DENSE_KEYS)
+			{
+				if (!entry.resource)
+					shard.index.erase(id);
+			}
+		}
+
+		// must be called with the lock of the entry's shard held
+		void _install(CachedResource &entry, resource_type resource, size_t size)
+		{
+			if (!entry.resource)
+				_resident_entries.fetch_add(1, std::memory_order_relaxed);
+			_resident_bytes.fetch_add(size, std::memory_order_relaxed);
+			_resident_bytes.fetch_sub(entry.size, std::memory_order_relaxed);
+			entry.resource = std::move(resource);
+			entry.size = size;
+		}
+
+		// must be called with the lock of the entry's shard held
+		void _release(CachedResource &entry)
+		{
+			_resident_entries.fetch_sub(1, std::memory_order_relaxed);
+			_resident_bytes.fetch_sub(entry.size, std::memory_order_relaxed);
+			entry.resource = nullptr;
+			entry.size = 0;
+		}
+
+		bool _overBudget() const
+		{
+			size_t max_entries = _max_resident_entries.load(std::memory_order_relaxed);
+			size_t max_bytes = _max_resident_bytes.load(std::memory_order_relaxed);
+
+			return ((max_entries && _resident_entries.load(std::memory_order_relaxed) > max_entries) ||
+			        (max_bytes && _resident_bytes.load(std::memory_order_relaxed) > max_bytes));
+		}
+
+		// second chance : an entry that was touched since the hand last went past it is spared this time
+		// must be called with the lock of the entry's shard held
+		bool _expendable(CachedResource &entry)
+		{
+			if (!entry.resource || entry.load)
+				return (false);
+			if (app_time touched = entry.last_touched.load(std::memory_order_relaxed); touched > entry.last_swept)
+			{
+				entry.last_swept = std::chrono::steady_clock::now();
+				return (false);
+			}
+			return (true);
+		}
+
+		// CLOCK eviction : the hand goes around the storage, an entry that was touched since the hand last went past it
+		// gets a second chance, otherwise it is dropped from memory. accessors still holding the resource keep it alive.
+		// must be called without holding any shard lock
+		void _enforceBudget()
+		{
+			if (!_overBudget())
+				return;
+
+			std::unique_lock sweep_lock{_sweep_mutex, std::try_to_lock};
+
+			if (!sweep_lock.owns_lock()) // someone is already sweeping
+				return;
+
+			if constexpr (DENSE_KEYS)
+				_sweepDense();
+			else
+				_sweepWide();
+		}
+
+		// the hand goes through IDs, must be called with _sweep_mutex held
+		void _sweepDense()
+		{
+			const size_t slots = _capacity.load(std::memory_order_relaxed);
+
+			// two turns of the hand are enough to clear every second chance
+			for (size_t i = 0; i < slots * 2 && _overBudget(); ++i)
+			{
+				auto id = static_cast<ID>(_clock_hand % slots);
+
+				_clock_hand = (_clock_hand + 1) % slots;
+
+				CachedResource *entry = _fetch(id);
+
+				if (!entry)
+					continue;
+
+				Shard &shard = _shard(id);
+				std::scoped_lock lock{shard.mutex};
+
+				if (_expendable(*entry))
+				{
+					_release(*entry);
+					_evictions.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// each shard has its own hand going through the slots of its index, the shards take turns one slot at a time
+		// evicted entries are erased from the index, must be called with _sweep_mutex held
+		void _sweepWide()
+		{
+			size_t slots = 0;
+
+			for (Shard &shard : _shards)
+			{
+				std::scoped_lock lock{shard.mutex};
+
+				slots += shard.index.capacity();
+			}
+			for (size_t i = 0; i < slots * 2 && _overBudget(); ++i)
+			{
+				Shard &shard = _shards[_clock_hand];
+
+				_clock_hand = (_clock_hand + 1) % SHARD_COUNT;
+
+				std::scoped_lock lock{shard.mutex};
+				WideIndex &index = shard.index;
+
+				if (!index.capacity())
+					continue;
+
+				size_t slot = shard.clock_hand % index.capacity();
+
+				if (index.occupied(slot))
+				{
+					CachedResource &entry = index.value_at(slot);
+					bool            unused = !entry.resource && !entry.load &&
+					                         entry.missing_until <= std::chrono::steady_clock::now();
+
+					if (unused || _expendable(entry))
+					{
+						if (!unused)
+						{
+							_release(entry);
+							_evictions.fetch_add(1, std::memory_order_relaxed);
+						}
+						// the next entry of the probe sequence may have been shifted into this slot, the hand stays to look at it
+						index.erase_at(slot);
+						continue;
+					}
+				}
+				shard.clock_hand = slot + 1;
+			}
+		}
+
+		auto _shard(ID id) -> Shard &
+		{
+			if constexpr (DENSE_KEYS)
+				return (_shards[static_cast<size_t>(id) % SHARD_COUNT]);
+			else
+			{
+				// the low bits of a snowflake are a per-process increment, fold the timestamp in
+				auto value = static_cast<uint64>(id);
+
+				return (_shards[(value ^ (value >> 22) ^ (value >> 44)) % SHARD_COUNT]);
+			}
 		}
 		
+		// dense keys only, returns nullptr if the entry was never used
 		auto _fetch(ID id) -> CachedResource *
 		{
-			if (id < _storage.size())
-				return (&_storage[id]);
+			Chunk *chunk = _chunks[static_cast<size_t>(id) / CHUNK_SIZE].load(std::memory_order_acquire);
+
+			if (chunk)
+				return (&(*chunk)[static_cast<size_t>(id) % CHUNK_SIZE]);
 			return (nullptr);
 		}
 
-		auto _retrieve(ID id) -> CachedResource &
+		// must be called with the lock of the entry's shard held
+		auto _retrieve([[maybe_unused]] Shard &shard, ID id) -> CachedResource &
 		{
-			if (id < _storage.size())
-				return (_storage[id]);
-			return (_extras[id]);
+			if constexpr (!DENSE_KEYS)
+				return (*shard.index.try_emplace(id).first);
+			else
+			{
+				std::atomic<Chunk *> &slot = _chunks[static_cast<size_t>(id) / CHUNK_SIZE];
+				Chunk *chunk = slot.load(std::memory_order_acquire);
+
+				// chunks are shared between shards
+				if (!chunk)
+				{
+					auto new_chunk = std::make_unique<Chunk>();
+
+					if (slot.compare_exchange_strong(chunk, new_chunk.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+						chunk = new_chunk.release();
+				}
+				return ((*chunk)[static_cast<size_t>(id) % CHUNK_SIZE]);
+			}
 		}
 		
-		ID _max_entries = std::numeric_limits<ID>::max();
-		Storage _storage;
-		std::unordered_map<ID, CachedResource> _extras;
+		std::atomic<size_t> _capacity;
+		std::atomic<bool>   _bounded = false; // whether _capacity was set, or is still the whole range of ID
+		std::vector<size_t> _ids;               // listed by the API, dense keys only
+		mutable std::mutex  _ids_mutex;
+		std::array<std::atomic<Chunk *>, CHUNK_COUNT> _chunks{};
+		std::array<Shard, SHARD_COUNT> _shards;
+
+		std::atomic<size_t> _max_resident_entries;
+		std::atomic<size_t> _max_resident_bytes;
+		std::mutex          _sweep_mutex;
+		size_t              _clock_hand = 0; // an ID with dense keys, a shard with wide keys
+
+		std::atomic<bool>   _stale_while_revalidate;
+
+		std::atomic<std::chrono::seconds> _negative_ttl;
+		std::atomic<uint32>               _failure_threshold;
+		std::atomic<std::chrono::seconds> _backoff_min;
+		std::atomic<std::chrono::seconds> _backoff_max;
+		std::atomic<uint32>               _consecutive_failures = 0;
+		std::atomic<app_time>             _breaker_open_until{};
+
+		std::atomic<uint64> _hits             = 0;
+		std::atomic<uint64> _stale_hits       = 0;
+		std::atomic<uint64> _misses           = 0;
+		std::atomic<uint64> _evictions        = 0;
+		std::atomic<uint64> _negative_hits    = 0;
+		std::atomic<uint64> _short_circuits   = 0;
+		std::atomic<uint64> _fetched_bytes    = 0;
+		std::atomic<size_t> _resident_entries = 0;
+		std::atomic<size_t> _resident_bytes   = 0;
 		
-		using NameResolver = std::conditional_t<CanUseName, std::unordered_map<std::string, ID>, empty_t>;
+		using NameResolver = std::conditional_t<CanUseName, NameIndex, empty_t>;
 		
 		NameResolver _resolver;
-		std::mutex _mutex;
+
+		// negative cache for names, IDs have theirs in their entry
+		static constexpr inline size_t MAX_MISSING_NAMES = 1024;
+
+		using MissingNames = std::conditional_t<CanUseName, std::unordered_map<std::string, app_time>, empty_t>;
+
+		std::mutex   _missing_names_mutex;
+		MissingNames _missing_names;
+
+		// requests by name in flight, by normalized name
+		using PendingNames = std::conditional_t<CanUseName, std::unordered_map<std::string, load_type>, empty_t>;
+
+		std::mutex   _pending_names_mutex;
+		PendingNames _pending_names;
+
+		ResourcePack _pack;
+		bool         _use_pack = false;
 	};
 	
 	template <API_type T, template <typename...> typename... Resources>
@@ -23,6 +23,13 @@ namespace B12
 		return {std::nullopt};
 	};
 	
+	// the ID of a resource that has none, all bits set ; numeric_limits is 0 for class IDs such as dpp::snowflake
+	template <typename ID>
+	ID no_resource_id()
+	{
+		return (static_cast<ID>(~uint64{0}));
+	}
+
 	template <shion::basic_string_literal Name, typename ID>
 	struct APIResource
 	{
@@ -30,7 +37,7 @@ namespace B12
 		static inline constexpr auto NAME = Name;
 		
 		json resource;
-		ID id = resource_id<APIResource>(resource).value_or(std::numeric_limits<ID>::max());
+		ID id = resource_id<APIResource>(resource).value_or(no_resource_id<ID>());
 	};
 
 	template <typename T>
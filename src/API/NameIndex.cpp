@@ -0,0 +1,212 @@
+#include "B12.h"
+
+#include "NameIndex.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+
+using namespace B12;
+
+namespace
+{
+	// names are padded so that their first and last letters weigh as much as the others
+	auto trigrams_of(std::string_view name) -> std::vector<uint32>
+	{
+		std::string         padded = fmt::format("  {} ", name);
+		std::vector<uint32> trigrams;
+
+		trigrams.reserve(padded.size() - 2);
+		for (size_t i = 0; i + 2 < padded.size(); ++i)
+		{
+			auto c = [&](size_t n) { return (static_cast<uint32>(static_cast<uint8>(padded[i + n]))); };
+
+			trigrams.push_back((c(0) << 16) | (c(1) << 8) | c(2));
+		}
+		std::ranges::sort(trigrams);
+		trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+		return (trigrams);
+	}
+
+	// how many names starting with the query are looked at, short queries match a lot of them
+	constexpr size_t MAX_PREFIX_MATCHES = 256;
+}
+
+auto NameIndex::normalize(std::string_view name) -> std::string
+{
+	std::string ret;
+
+	while (!name.empty() && is_whitespace(name.front()))
+		name.remove_prefix(1);
+	while (!name.empty() && is_whitespace(name.back()))
+		name.remove_suffix(1);
+	ret.reserve(name.size());
+	for (char c : name)
+	{
+		if (c >= 'A' && c <= 'Z')
+			ret += static_cast<char>(c - 'A' + 'a');
+		else if (c == ' ' || c == '_')
+			ret += '-';
+		else
+			ret += c;
+	}
+	return (ret);
+}
+
+bool NameIndex::open(std::filesystem::path path)
+{
+	std::unique_lock lock{_mutex};
+	std::error_code  err;
+
+	_path = std::move(path);
+	if (auto parent = _path.parent_path(); !parent.empty() && !create_directories(parent, err) && err)
+	{
+		B12::log(LogLevel::ERROR, "Failed to create directories for path {}", parent.string());
+		return (false);
+	}
+	if (std::ifstream fs{_path}; fs.good())
+	{
+		std::string line;
+
+		while (std::getline(fs, line))
+		{
+			std::string_view view = line;
+			uint64           id;
+			size_t           tab = view.find('\t');
+
+			if (tab == std::string_view::npos ||
+			    std::from_chars(view.data(), view.data() + tab, id).ec != std::errc{})
+				continue;
+			_insert(std::string{view.substr(tab + 1)}, id);
+		}
+	}
+	_file = std::fopen(_path.string().c_str(), "ab");
+	if (!_file.hasResource())
+	{
+		B12::log(LogLevel::ERROR, "Failed to open name index {} for writing", _path.string());
+		return (false);
+	}
+	B12::log(LogLevel::TRACE, "Opened name index {} : {} names", _path.string(), _names.size());
+	return (true);
+}
+
+bool NameIndex::insert(std::string_view name, uint64 id)
+{
+	std::string normalized = normalize(name);
+
+	if (normalized.empty() || normalized.find_first_of("\t\n") != std::string::npos)
+		return (false);
+
+	std::unique_lock lock{_mutex};
+
+	if (!_insert(normalized, id))
+		return (false);
+	if (_file.hasResource() && (std::fprintf(_file.get(), "%llu\t%s\n", static_cast<unsigned long long>(id), normalized.c_str()) < 0 ||
+	                            std::fflush(_file.get()) != 0))
+	{
+		B12::log(LogLevel::ERROR, "Failed to write to name index {}, disabling writes", _path.string());
+		_file = nullptr;
+	}
+	return (true);
+}
+
+bool NameIndex::_insert(std::string name, uint64 id)
+{
+	if (auto it = _by_name.find(name); it != _by_name.end())
+	{
+		Name &entry = _names[it->second];
+
+		if (entry.id == id)
+			return (false);
+		entry.id = id;
+		return (true);
+	}
+
+	auto                index    = static_cast<uint32>(_names.size());
+	std::vector<uint32> trigrams = trigrams_of(name);
+	auto                position = std::ranges::lower_bound(_sorted, name, std::less{}, [this](uint32 i) -> std::string_view
+	{
+		return (_names[i].name);
+	});
+
+	for (uint32 trigram : trigrams)
+		_trigrams[trigram].push_back(index);
+	_sorted.insert(position, index);
+	_by_name.try_emplace(name, index);
+	_names.push_back({std::move(name), id, static_cast<uint32>(trigrams.size())});
+	return (true);
+}
+
+auto NameIndex::find(std::string_view name) const -> std::optional<uint64>
+{
+	std::string      normalized = normalize(name);
+	std::shared_lock lock{_mutex};
+
+	if (auto it = _by_name.find(normalized); it != _by_name.end())
+		return {_names[it->second].id};
+	return {std::nullopt};
+}
+
+auto NameIndex::search(std::string_view query, size_t max_results) const -> std::vector<Match>
+{
+	std::string normalized = normalize(query);
+
+	if (normalized.empty() || !max_results)
+		return {};
+
+	std::vector<uint32>               query_trigrams = trigrams_of(normalized);
+	std::unordered_map<uint32, float> scores;
+	std::shared_lock                  lock{_mutex};
+
+	// similarity is the Dice coefficient of the trigram sets
+	{
+		std::unordered_map<uint32, uint32> shared;
+
+		for (uint32 trigram : query_trigrams)
+		{
+			if (auto it = _trigrams.find(trigram); it != _trigrams.end())
+			{
+				for (uint32 index : it->second)
+					++shared[index];
+			}
+		}
+		for (auto [index, count] : shared)
+			scores[index] = (2.0f * count) / static_cast<float>(query_trigrams.size() + _names[index].trigram_count);
+	}
+
+	// names completing the query rank above their trigram similarity, more so the more of the name is typed
+	auto by_name = [this](uint32 i) -> std::string_view { return (_names[i].name); };
+	auto it      = std::ranges::lower_bound(_sorted, std::string_view{normalized}, std::less{}, by_name);
+
+	for (size_t i = 0; i < MAX_PREFIX_MATCHES && it != _sorted.end() && _names[*it].name.starts_with(normalized); ++i, ++it)
+	{
+		float prefix_score = 0.5f + 0.5f * static_cast<float>(normalized.size()) / static_cast<float>(_names[*it].name.size());
+		float &score       = scores[*it];
+
+		score = std::max(score, prefix_score);
+	}
+
+	std::vector<Match> matches;
+
+	for (auto [index, score] : scores)
+	{
+		if (score >= MIN_SCORE)
+			matches.push_back({_names[index].name, _names[index].id, score});
+	}
+	std::ranges::sort(matches, [](const Match &lhs, const Match &rhs)
+	{
+		if (lhs.score != rhs.score)
+			return (lhs.score > rhs.score);
+		return (lhs.name < rhs.name);
+	});
+	if (matches.size() > max_results)
+		matches.resize(max_results);
+	return (matches);
+}
+
+size_t NameIndex::size() const
+{
+	std::shared_lock lock{_mutex};
+
+	return (_names.size());
+}
@@ -0,0 +1,77 @@
+#ifndef B12_NAME_INDEX_H_
+#define B12_NAME_INDEX_H_
+
+#include "B12.h"
+
+#include <filesystem>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <shion/utils/owned_resource.h>
+
+namespace B12
+{
+	/*
+	 * name -> ID index of an API endpoint, with approximate lookup
+	 * names are normalized (lowercase, spaces and underscores as dashes, as the APIs spell them) before anything else
+	 * exact lookups are a hash map hit ; approximate ones look for names starting with the query and for names sharing trigrams with it
+	 * the index is persisted as an append-only list of "id\tname" lines, later lines replace earlier ones
+	 */
+	class NameIndex
+	{
+	public:
+		struct Match
+		{
+			std::string name;
+			uint64      id;
+			float       score; // 1 for an exact match, down to 0
+		};
+
+		// below that, a match has too little in common with the query to be worth suggesting
+		static constexpr inline float MIN_SCORE = 0.3f;
+
+		NameIndex() = default;
+		NameIndex(const NameIndex&) = delete;
+		NameIndex(NameIndex&&) = delete;
+
+		NameIndex &operator=(const NameIndex&) = delete;
+		NameIndex &operator=(NameIndex&&) = delete;
+
+		static auto normalize(std::string_view name) -> std::string;
+
+		bool open(std::filesystem::path path);
+
+		// returns true if the name was not known for this ID
+		bool insert(std::string_view name, uint64 id);
+
+		auto find(std::string_view name) const -> std::optional<uint64>;
+		auto search(std::string_view query, size_t max_results) const -> std::vector<Match>;
+
+		size_t size() const;
+
+	private:
+		struct Name
+		{
+			std::string name;
+			uint64      id;
+			uint32      trigram_count;
+		};
+
+		bool _insert(std::string name, uint64 id);
+
+		// names are never removed, they are referred to by their position in _names
+		std::vector<Name>                               _names;
+		std::unordered_map<std::string, uint32>         _by_name;
+		std::vector<uint32>                             _sorted;   // sorted by name, for prefix lookups
+		std::unordered_map<uint32, std::vector<uint32>> _trigrams; // trigram -> names containing it, in ascending order
+
+		std::filesystem::path       _path;
+		shion::utils::owned_stdfile _file;
+
+		mutable std::shared_mutex _mutex;
+	};
+} // namespace B12
+
+#endif
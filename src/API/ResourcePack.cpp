@@ -0,0 +1,397 @@
+#include "B12.h"
+
+#include "ResourcePack.h"
+
+#include <array>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+using namespace B12;
+
+namespace
+{
+	constexpr std::array<char, 8> PACK_MAGIC = {'B', '1', '2', 'P', 'A', 'C', 'K', 1};
+	constexpr uint32              RECORD_MAGIC = 0x52323142; // "B12R"
+
+	// records are written in native byte order, the pack is a local cache and is not meant to be moved across machines
+	struct RecordHeader
+	{
+		uint32 magic;
+		uint32 size;
+		uint64 id;
+		int64  time;
+	};
+
+	static_assert(std::is_trivially_copyable_v<RecordHeader> && sizeof(RecordHeader) == 24);
+
+	// the log is only compacted when opening, if at least half of it is made of replaced records
+	constexpr uint64 COMPACT_THRESHOLD = 1024 * 1024;
+
+	bool write_record(std::FILE* file, const RecordHeader& header, const void* data)
+	{
+		if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+			return (false);
+		if (header.size > 0 && std::fwrite(data, header.size, 1, file) != 1)
+			return (false);
+		return (true);
+	}
+}
+
+ResourcePack::~ResourcePack()
+{
+	close();
+}
+
+bool ResourcePack::open(std::filesystem::path path)
+{
+	std::unique_lock lock{_mutex};
+	std::error_code  err;
+
+	_path = std::move(path);
+	if (auto parent = _path.parent_path(); !parent.empty() && !create_directories(parent, err) && err)
+	{
+		B12::log(LogLevel::ERROR, "Failed to create directories for path {}", parent.string());
+		return (false);
+	}
+	if (auto size = std::filesystem::file_size(_path, err); err || size < PACK_MAGIC.size())
+	{
+		shion::utils::owned_stdfile file{std::fopen(_path.string().c_str(), "wb")};
+
+		if (!file.hasResource() || std::fwrite(PACK_MAGIC.data(), PACK_MAGIC.size(), 1, file.get()) != 1)
+		{
+			B12::log(LogLevel::ERROR, "Failed to create resource pack {}", _path.string());
+			return (false);
+		}
+	}
+	if (!_map() || !_scan())
+	{
+		_unmap();
+		return (false);
+	}
+	if (_dead_bytes > COMPACT_THRESHOLD && _dead_bytes * 2 > _end)
+		_compact();
+	_file = std::fopen(_path.string().c_str(), "ab");
+	if (!_file.hasResource())
+	{
+		B12::log(LogLevel::ERROR, "Failed to open resource pack {} for writing", _path.string());
+		_unmap();
+		return (false);
+	}
+	B12::log(LogLevel::TRACE, "Opened resource pack {} : {} resources", _path.string(), _index.size());
+	return (true);
+}
+
+void ResourcePack::close()
+{
+	std::unique_lock lock{_mutex};
+
+	if (_file.hasResource())
+		_file = nullptr;
+	_unmap();
+	_index.clear();
+	_end        = 0;
+	_dead_bytes = 0;
+}
+
+bool ResourcePack::isOpen() const
+{
+	std::shared_lock lock{_mutex};
+
+	return (_file.hasResource());
+}
+
+auto ResourcePack::load(uint64 id) const -> std::optional<Record>
+{
+	{
+		std::shared_lock lock{_mutex};
+		auto             it = _index.find(id);
+
+		if (it == _index.end())
+			return {std::nullopt};
+		if (it->second.offset + it->second.size <= _view_size)
+			return (_read(id, it->second));
+	}
+
+	// written since the file was mapped
+	std::unique_lock lock{_mutex};
+	auto             it = _index.find(id);
+
+	if (it == _index.end())
+		return {std::nullopt};
+	if (it->second.offset + it->second.size > _view_size && (!_remap() || it->second.offset + it->second.size > _view_size))
+		return {std::nullopt};
+	return (_read(id, it->second));
+}
+
+auto ResourcePack::_read(uint64 id, const IndexEntry& entry) const -> std::optional<Record>
+{
+	auto* begin = reinterpret_cast<const uint8*>(_view + entry.offset);
+	json  value = json::from_cbor(begin, begin + entry.size, true, false);
+
+	if (value.is_discarded())
+	{
+		B12::log(LogLevel::ERROR, "Failed to decode resource {} from pack {}", id, _path.string());
+		return {std::nullopt};
+	}
+	return {Record{std::move(value), entry.size, entry.time}};
+}
+
+auto ResourcePack::time(uint64 id) const -> std::optional<file_time>
+{
+	std::shared_lock lock{_mutex};
+
+	if (auto it = _index.find(id); it != _index.end())
+		return {it->second.time};
+	return {std::nullopt};
+}
+
+bool ResourcePack::store(uint64 id, const json& value, file_time time)
+{
+	std::vector<uint8> data = json::to_cbor(value);
+	std::unique_lock   lock{_mutex};
+
+	if (!_file.hasResource())
+		return (false);
+
+	RecordHeader header{RECORD_MAGIC, static_cast<uint32>(data.size()), id, time.time_since_epoch().count()};
+
+	if (!write_record(_file.get(), header, data.data()) || std::fflush(_file.get()) != 0)
+	{
+		// the end of the file is now unknown, stop writing ; the torn record will be truncated on the next open
+		B12::log(LogLevel::ERROR, "Failed to write resource {} to pack {}, disabling writes", id, _path.string());
+		_file = nullptr;
+		return (false);
+	}
+
+	IndexEntry entry{_end + sizeof(RecordHeader), header.size, time};
+
+	if (auto [it, inserted] = _index.try_emplace(id, entry); !inserted)
+	{
+		_dead_bytes += sizeof(RecordHeader) + it->second.size;
+		it->second   = entry;
+	}
+	_end += sizeof(RecordHeader) + header.size;
+	return (true);
+}
+
+bool ResourcePack::_scan()
+{
+	uint64 offset = PACK_MAGIC.size();
+
+	if (_view_size < PACK_MAGIC.size() || std::memcmp(_view, PACK_MAGIC.data(), PACK_MAGIC.size()) != 0)
+	{
+		B12::log(LogLevel::ERROR, "{} is not a resource pack", _path.string());
+		return (false);
+	}
+	_index.clear();
+	_dead_bytes = 0;
+	while (offset + sizeof(RecordHeader) <= _view_size)
+	{
+		RecordHeader header;
+
+		std::memcpy(&header, _view + offset, sizeof(header));
+		if (header.magic != RECORD_MAGIC || offset + sizeof(header) + header.size > _view_size)
+			break;
+
+		IndexEntry entry{offset + sizeof(header), header.size, file_time{file_time::duration{header.time}}};
+
+		if (auto [it, inserted] = _index.try_emplace(header.id, entry); !inserted)
+		{
+			_dead_bytes += sizeof(RecordHeader) + it->second.size;
+			it->second   = entry;
+		}
+		offset += sizeof(header) + header.size;
+	}
+	_end = offset;
+	if (offset != _view_size)
+	{
+		// most likely a record torn by a crash, drop it so the next ones are appended after a valid record
+		std::error_code err;
+
+		B12::log(LogLevel::ERROR, "Resource pack {} has a corrupted tail, truncating {} bytes", _path.string(), _view_size - offset);
+		_unmap();
+		std::filesystem::resize_file(_path, offset, err);
+		if (err)
+		{
+			B12::log(LogLevel::ERROR, "Failed to truncate resource pack {}: {}", _path.string(), err.message());
+			return (false);
+		}
+		return (_map());
+	}
+	return (true);
+}
+
+// the old view is kept if the file cannot be mapped again
+bool ResourcePack::_remap() const
+{
+	const std::byte* view           = std::exchange(_view, nullptr);
+	size_t           view_size      = std::exchange(_view_size, 0);
+	void*            mapping_handle = std::exchange(_mapping_handle, nullptr);
+
+	if (!_map())
+	{
+		_view           = view;
+		_view_size      = view_size;
+		_mapping_handle = mapping_handle;
+		return (false);
+	}
+	_unmapView(view, view_size, mapping_handle);
+	return (true);
+}
+
+void ResourcePack::_unmap() const
+{
+	_unmapView(_view, _view_size, _mapping_handle);
+	_view           = nullptr;
+	_view_size      = 0;
+	_mapping_handle = nullptr;
+}
+
+bool ResourcePack::_compact()
+{
+	std::filesystem::path tmp_path = _path;
+	std::error_code       err;
+	uint64                offset = PACK_MAGIC.size();
+	decltype(_index)      index;
+
+	tmp_path += ".tmp";
+	{
+		shion::utils::owned_stdfile file{std::fopen(tmp_path.string().c_str(), "wb")};
+
+		if (!file.hasResource() || std::fwrite(PACK_MAGIC.data(), PACK_MAGIC.size(), 1, file.get()) != 1)
+			return (false);
+		for (const auto& [id, entry] : _index)
+		{
+			RecordHeader header{RECORD_MAGIC, entry.size, id, entry.time.time_since_epoch().count()};
+
+			if (!write_record(file.get(), header, _view + entry.offset))
+			{
+				B12::log(LogLevel::ERROR, "Failed to compact resource pack {}", _path.string());
+				return (false);
+			}
+			index.try_emplace(id, IndexEntry{offset + sizeof(header), entry.size, entry.time});
+			offset += sizeof(header) + entry.size;
+		}
+	}
+	_unmap();
+	std::filesystem::rename(tmp_path, _path, err);
+	if (err)
+	{
+		B12::log(LogLevel::ERROR, "Failed to replace resource pack {}: {}", _path.string(), err.message());
+		return (_map());
+	}
+	B12::log(LogLevel::TRACE, "Compacted resource pack {} : {} bytes reclaimed", _path.string(), _dead_bytes);
+	_index      = std::move(index);
+	_end        = offset;
+	_dead_bytes = 0;
+	return (_map());
+}
+
+#ifdef _WIN32
+
+bool ResourcePack::_map() const
+{
+	HANDLE file = CreateFileW(
+		_path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr
+	);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		B12::log(LogLevel::ERROR, "Failed to open resource pack {} for mapping", _path.string());
+		return (false);
+	}
+
+	LARGE_INTEGER size;
+
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return (false);
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	CloseHandle(file);
+	if (!mapping)
+	{
+		B12::log(LogLevel::ERROR, "Failed to map resource pack {}", _path.string());
+		return (false);
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (!view)
+	{
+		B12::log(LogLevel::ERROR, "Failed to map resource pack {}", _path.string());
+		CloseHandle(mapping);
+		return (false);
+	}
+	_mapping_handle = mapping;
+	_view           = static_cast<const std::byte*>(view);
+	_view_size      = static_cast<size_t>(size.QuadPart);
+	return (true);
+}
+
+void ResourcePack::_unmapView(const std::byte* view, size_t, void* mapping_handle)
+{
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+}
+
+#else
+
+bool ResourcePack::_map() const
+{
+	int fd = ::open(_path.c_str(), O_RDONLY);
+
+	if (fd < 0)
+	{
+		B12::log(LogLevel::ERROR, "Failed to open resource pack {} for mapping", _path.string());
+		return (false);
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return (false);
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+	::close(fd);
+	if (view == MAP_FAILED)
+	{
+		B12::log(LogLevel::ERROR, "Failed to map resource pack {}", _path.string());
+		return (false);
+	}
+	_view      = static_cast<const std::byte*>(view);
+	_view_size = static_cast<size_t>(st.st_size);
+	return (true);
+}
+
+void ResourcePack::_unmapView(const std::byte* view, size_t size, void*)
+{
+	if (view)
+		munmap(const_cast<std::byte*>(view), size);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef B12_RESOURCE_PACK_H_
+#define B12_RESOURCE_PACK_H_
+
+#include "B12.h"
+
+#include <filesystem>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <shion/utils/owned_resource.h>
+
+namespace B12
+{
+	/*
+	 * single-file persistent store for API resources, encoded as CBOR
+	 * the file is a log of records, a record for an ID replaces any previous one ;
+	 * the ID -> offset index is rebuilt when opening, and reads are served from a read-only memory mapping of the file
+	 * the mapping is not redone on every write, only when a read reaches past its end
+	 */
+	class ResourcePack
+	{
+	public:
+		struct Record
+		{
+			json      value;
+			size_t    size; // size of the encoded resource
+			file_time time;
+		};
+
+		ResourcePack() = default;
+		ResourcePack(const ResourcePack&) = delete;
+		ResourcePack(ResourcePack&&) = delete;
+		~ResourcePack();
+
+		ResourcePack &operator=(const ResourcePack&) = delete;
+		ResourcePack &operator=(ResourcePack&&) = delete;
+
+		bool open(std::filesystem::path path);
+		void close();
+		bool isOpen() const;
+
+		auto load(uint64 id) const -> std::optional<Record>;
+		auto time(uint64 id) const -> std::optional<file_time>;
+		bool store(uint64 id, const json &value, file_time time);
+
+	private:
+		struct IndexEntry
+		{
+			uint64    offset;
+			uint32    size;
+			file_time time;
+		};
+
+		auto _read(uint64 id, const IndexEntry& entry) const -> std::optional<Record>;
+		bool _scan();
+		bool _compact();
+		bool _map() const;
+		bool _remap() const;
+		void _unmap() const;
+
+		static void _unmapView(const std::byte* view, size_t size, void* mapping_handle);
+
+		std::filesystem::path                  _path;
+		shion::utils::owned_stdfile            _file;
+		std::unordered_map<uint64, IndexEntry> _index;
+		uint64                                 _end{0};
+		uint64                                 _dead_bytes{0};
+
+		// the file as it was when last mapped, records appended since are past its end
+		mutable const std::byte* _view{nullptr};
+		mutable size_t           _view_size{0};
+		mutable void*            _mapping_handle{nullptr};
+
+		mutable std::shared_mutex _mutex;
+	};
+} // namespace B12
+
+#endif
@@ -0,0 +1,181 @@
+#include "B12.h"
+
+#include "ResourcePrefetcher.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+
+using namespace B12;
+
+namespace
+{
+	// how often to look again when there is nothing to do yet, or the API is failing
+	constexpr auto IDLE_DELAY = std::chrono::seconds{5};
+
+	// how often to check whether a request completed
+	constexpr auto POLL_DELAY = std::chrono::milliseconds{50};
+
+	// a request that takes longer than this is given up on, the cache still gets the resource if it comes
+	constexpr auto REQUEST_TIMEOUT = std::chrono::seconds{30};
+
+	// progress is saved every this many IDs
+	constexpr size_t SAVE_INTERVAL = 16;
+}
+
+ResourcePrefetcher::ResourcePrefetcher(dpp::cluster *cluster, PrefetchConfig config) :
+	_cluster{cluster},
+	_config{config}
+{
+}
+
+ResourcePrefetcher::~ResourcePrefetcher()
+{
+	stop();
+}
+
+void ResourcePrefetcher::start()
+{
+	if (!_config.enabled || _thread.joinable() || _walks.empty())
+		return;
+	for (Walk &walk : _walks)
+		walk.next = _loadProgress(walk.progress_path);
+	_thread = std::jthread{[this](std::stop_token stop) { _run(stop); }};
+}
+
+void ResourcePrefetcher::stop()
+{
+	if (!_thread.joinable())
+		return;
+	_thread.request_stop();
+	_thread.join();
+	for (Walk &walk : _walks)
+		_saveProgress(walk.progress_path, walk.done ? 0 : walk.next);
+}
+
+void ResourcePrefetcher::_run(std::stop_token stop)
+{
+	const auto min_interval = (_config.requests_per_minute ?
+	                           std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::minutes{1}) / _config.requests_per_minute :
+	                           std::chrono::milliseconds{0});
+
+	B12::log(LogLevel::TRACE, "Prefetcher started");
+	while (!stop.stop_requested())
+	{
+		bool requested = false;
+		bool pending = false;
+
+		// walks take turns, one request each
+		for (Walk &walk : _walks)
+		{
+			if (walk.done)
+				continue;
+			if (_config.max_requests && _requests >= _config.max_requests)
+			{
+				B12::log(LogLevel::TRACE, "Prefetcher reached its budget of {} requests", _config.max_requests);
+				return;
+			}
+			pending = true;
+
+			uint64 bytes = walk.fetched_bytes();
+
+			if (!_step(walk, stop))
+				continue;
+			requested = true;
+			++_requests;
+
+			auto delay = min_interval;
+
+			// pace the bandwidth over the minute, from what this request cost
+			if (_config.bytes_per_minute)
+			{
+				auto cost = std::chrono::milliseconds{static_cast<int64>((walk.fetched_bytes() - bytes) * 60'000 / _config.bytes_per_minute)};
+
+				delay = std::max(delay, cost);
+			}
+			if (!_sleep(delay, stop))
+				return;
+		}
+		if (!pending)
+		{
+			B12::log(LogLevel::TRACE, "Prefetcher finished");
+			return;
+		}
+		if (!requested && !_sleep(IDLE_DELAY, stop))
+			return;
+	}
+}
+
+// returns true if a request was made
+bool ResourcePrefetcher::_step(Walk &walk, std::stop_token stop)
+{
+	if (walk.listed.empty())
+		walk.listed = walk.ids();
+	// the IDs are not known yet, or the API is failing ; try again later
+	if (walk.listed.empty() || !walk.available())
+		return (false);
+	for (auto it = std::ranges::lower_bound(walk.listed, walk.next); it != walk.listed.end() && !stop.stop_requested(); ++it)
+	{
+		size_t id = *it;
+
+		walk.next = id + 1;
+		if ((static_cast<size_t>(it - walk.listed.begin()) + 1) % SAVE_INTERVAL == 0)
+			_saveProgress(walk.progress_path, walk.next);
+
+		std::function<bool()> ready = walk.fetch(id);
+
+		if (!ready)
+			continue;
+
+		auto start = std::chrono::steady_clock::now();
+
+		while (!ready() && std::chrono::steady_clock::now() - start < REQUEST_TIMEOUT)
+		{
+			if (!_sleep(POLL_DELAY, stop))
+				break;
+		}
+		return (true);
+	}
+	if (walk.next > walk.listed.back())
+	{
+		B12::log(LogLevel::TRACE, "Prefetcher went through {} : {} IDs", walk.name, walk.listed.size());
+		walk.done = true;
+		_saveProgress(walk.progress_path, 0);
+	}
+	return (false);
+}
+
+// returns false if stop was requested
+bool ResourcePrefetcher::_sleep(std::chrono::milliseconds duration, std::stop_token stop)
+{
+	std::mutex                  mutex;
+	std::condition_variable_any cv;
+	std::unique_lock            lock{mutex};
+
+	cv.wait_for(lock, stop, duration, []() { return (false); });
+	return (!stop.stop_requested());
+}
+
+auto ResourcePrefetcher::_loadProgress(const std::filesystem::path &path) -> size_t
+{
+	size_t next = 0;
+
+	if (std::ifstream fs{path}; fs.good() && (fs >> next))
+		return (next);
+	return (0);
+}
+
+void ResourcePrefetcher::_saveProgress(const std::filesystem::path &path, size_t next)
+{
+	std::error_code err;
+
+	if (auto parent_path = path.parent_path(); !parent_path.empty() && !create_directories(parent_path, err) && err)
+	{
+		B12::log(LogLevel::ERROR, "Failed to create directories for path {}", parent_path.string());
+		return;
+	}
+	if (std::ofstream fs{path, std::ios::out | std::ios::trunc}; fs.good())
+		fs << next;
+	else
+		B12::log(LogLevel::ERROR, "Failed to save prefetch progress to {}", path.string());
+}
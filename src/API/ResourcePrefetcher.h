@@ -0,0 +1,103 @@
+#ifndef B12_RESOURCE_PREFETCHER_H_
+#define B12_RESOURCE_PREFETCHER_H_
+
+#include "B12.h"
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace B12
+{
+	struct PrefetchConfig
+	{
+		bool enabled = false;
+
+		// budget of the prefetcher, on top of what users ask for ; 0 means unlimited
+		uint32 requests_per_minute = 20;
+		size_t bytes_per_minute    = 0;
+		size_t max_requests        = 0; // per run of the bot
+	};
+
+	/*
+	 * warms resource caches in the background : walks the IDs each cache knows the API lists, one request at a time,
+	 * fetching what is neither in memory nor saved on disk and up to date
+	 * the position of each walk is saved, a restart continues where the last run stopped ; a finished walk starts over on the next run,
+	 * which only costs requests for the resources that went out of date
+	 */
+	class ResourcePrefetcher
+	{
+	public:
+		ResourcePrefetcher(dpp::cluster *cluster, PrefetchConfig config);
+		ResourcePrefetcher(const ResourcePrefetcher&) = delete;
+		ResourcePrefetcher(ResourcePrefetcher&&) = delete;
+		~ResourcePrefetcher();
+
+		ResourcePrefetcher &operator=(const ResourcePrefetcher&) = delete;
+		ResourcePrefetcher &operator=(ResourcePrefetcher&&) = delete;
+
+		// the cache must outlive the prefetcher, and caches must all be added before start()
+		template <typename Cache>
+		void add(Cache &cache)
+		{
+			static_assert(Cache::DENSE_KEYS, "only dense ID spaces can be walked");
+
+			_walks.push_back({
+				.name = std::string{Cache::Endpoint::PATH.data},
+				.progress_path = Cache::prefetchPath(),
+				.ids = [&cache]() { return (cache.ids()); },
+				.available = [&cache]() { return (cache.isUpstreamAvailable()); },
+				.fetched_bytes = [&cache]() { return (cache.stats().fetched_bytes); },
+				.fetch = [&cache, cluster = _cluster](size_t id) -> std::function<bool()>
+				{
+					auto accessor = cache.prefetch(cluster, static_cast<typename Cache::Resource::id_type>(id));
+
+					if (!accessor)
+						return {};
+					return ([accessor = std::make_shared<typename Cache::ResourceAccessor>(std::move(*accessor))]() {
+						return (accessor->await_ready());
+					});
+				}
+			});
+		}
+
+		void start();
+		void stop();
+
+	private:
+		struct Walk
+		{
+			std::string           name;
+			std::filesystem::path progress_path;
+
+			std::function<std::vector<size_t>()> ids;
+			std::function<bool()>                available;
+			std::function<uint64()>              fetched_bytes;
+
+			// starts loading a resource, returns nothing if there was nothing to do, or something to poll for completion
+			std::function<std::function<bool()>(size_t)> fetch;
+
+			std::vector<size_t> listed; // the IDs to walk, in order, once the cache knows them
+			size_t              next = 0; // the lowest ID not walked yet
+			bool                done = false;
+		};
+
+		void _run(std::stop_token stop);
+		bool _step(Walk &walk, std::stop_token stop);
+		bool _sleep(std::chrono::milliseconds duration, std::stop_token stop);
+
+		static auto _loadProgress(const std::filesystem::path &path) -> size_t;
+		static void _saveProgress(const std::filesystem::path &path, size_t next);
+
+		dpp::cluster      *_cluster;
+		PrefetchConfig     _config;
+		std::vector<Walk>  _walks;
+		size_t             _requests = 0;
+		std::jthread       _thread;
+	};
+} // namespace B12
+
+#endif
@@ -0,0 +1,62 @@
+#include "B12.h"
+
+#include "Core/Bot.h"
+
+#include "commands.h"
+
+using namespace B12;
+
+dpp::coroutine<command::response> command::admin_backup(dpp::interaction_create_t const &event)
+{
+	if (!Bot::isAdmin(event.command.usr.id))
+		co_return {response::usage_error("This command is reserved to the bot's administrators.")};
+	if (!Bot::requestBackup())
+		co_return {response::usage_error("Backups are disabled in the configuration.")};
+	co_return {response::success("A snapshot of the database is on its way.")};
+}
+
+dpp::coroutine<command::response> command::admin_queries(dpp::interaction_create_t const &event)
+{
+	// fields of an embed are limited to 1024 characters
+	static constexpr size_t max_statements = 10;
+	static constexpr size_t max_sql_length = 600;
+
+	if (!Bot::isAdmin(event.command.usr.id))
+		co_return {response::usage_error("This command is reserved to the bot's administrators.")};
+
+	auto profile = Bot::databaseProfile();
+
+	if (!profile)
+		co_return {response::usage_error("The database profiler is disabled in the configuration.")};
+	if (profile->empty())
+		co_return {response::success("No statement was recorded yet.")};
+
+	dpp::embed embed;
+
+	embed.set_title("Database statements by total time");
+	for (const QueryProfile &query : *profile | std::views::take(max_statements))
+	{
+		std::string_view sql = query.sql;
+
+		if (sql.size() > max_sql_length)
+			sql = sql.substr(0, max_sql_length);
+		embed.add_field(
+			fmt::format(
+				"{} calls, {:.1f}ms total, {:.2f}ms max",
+				query.calls,
+				static_cast<double>(query.total.count()) / 1'000'000.0,
+				static_cast<double>(query.max.count()) / 1'000'000.0
+			),
+			fmt::format(
+				"```sql\n{}\n```<10us/100us/1ms/10ms/100ms/1s/more: {}\n{} VM steps, {} full scan steps, {} sorts, {} automatic indexes",
+				sql,
+				fmt::join(query.histogram, "/"),
+				query.vm_steps,
+				query.full_scan_steps,
+				query.sorts,
+				query.auto_indexes
+			)
+		);
+	}
+	co_return {dpp::message{}.add_embed(embed).set_flags(dpp::m_ephemeral)};
+}
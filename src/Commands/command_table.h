@@ -26,7 +26,15 @@ namespace command {
 		command_info{"ban", "Ban a user", &ban,
 			{{"user", "User to ban"}, {"time", "Duration of the ban"}, {"reason", "Reason for the ban"}}
 		},
-		//command_info{"pokemon_dex", &command::pokemon_dex, {"name-or-number"}},
+		command_group{"admin", "Bot administration",
+			command_info{"backup", "Take a snapshot of the bot's database", &admin_backup},
+			command_info{"queries", "Show the statements the database spent the most time on", &admin_queries}
+		},
+		command_group{"pokemon", "Pokemon",
+			command_info{"dex", "Look up a pokemon in the Pokedex", &pokemon_dex,
+				{{"name-or-number", "Name or national number of the pokemon"}}
+			}
+		},
 		command_info{"poll", "Create a poll", &poll, {
 				{"title", "Title of the poll"},
 				{"option1", "Option 1 for the poll"},
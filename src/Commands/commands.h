@@ -75,6 +75,8 @@ namespace command {
 	dpp::coroutine<response> server_sticker_grab(dpp::interaction_create_t const &event, dpp::snowflake message_id, optional_param<const dpp::channel &> channel);
 	dpp::coroutine<response> bigmoji(dpp::interaction_create_t const &event, const std::string &emoji);
 	dpp::coroutine<response> ban(dpp::interaction_create_t const &event, resolved_user user, optional_param<std::chrono::seconds> duration, optional_param<std::string_view> reason);
+	dpp::coroutine<response> admin_backup(dpp::interaction_create_t const &event);
+	dpp::coroutine<response> admin_queries(dpp::interaction_create_t const &event);
 	dpp::coroutine<response> pokemon_dex(dpp::interaction_create_t const &event, const std::string &name_or_number);
 	dpp::coroutine<response> poll(
 		dpp::interaction_create_t const &event,
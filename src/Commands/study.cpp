@@ -113,7 +113,7 @@ dpp::coroutine<response> command::server_settings_study(dpp::interaction_create_
 		guild->studyRole(&role->get());
 		msg = fmt::format("{}role to {}", msg.empty() ? "" : fmt::format("{} and ", msg), role->get().get_mention());
 	}
-	if (!guild->saveSettings())
+	if (!co_await guild->saveSettings())
 	{
 		warnings.emplace_back(
 			"\n\xE2\x9A\xA0**There was an issue saving the settings, "
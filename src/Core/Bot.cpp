@@ -5,6 +5,7 @@
 #include "Data/Lang.h"
 
 #include <array>
+#include <charconv>
 
 #include "Commands/commands.h"
 #include "Commands/command_table.h"
@@ -52,6 +53,142 @@ constexpr auto dpp_log = [](const dpp::log_t& log)
 	Bot::log(level, "dpp: {}", log.message);
 };
 
+constexpr auto read_cache_config = [](const dpp::json& config) -> ResourceCacheConfig
+{
+	ResourceCacheConfig cache_config;
+
+	if (auto json = config.find("api_cache"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("max_entries"); value != json->end() && value->is_number_unsigned())
+			cache_config.max_entries = value->get<size_t>();
+		if (auto value = json->find("max_bytes"); value != json->end() && value->is_number_unsigned())
+			cache_config.max_bytes = value->get<size_t>();
+		if (auto value = json->find("stale_while_revalidate"); value != json->end() && value->is_boolean())
+			cache_config.stale_while_revalidate = value->get<bool>();
+		if (auto value = json->find("storage"); value != json->end() && value->is_string())
+			cache_config.storage = (value->get<std::string_view>() == "json" ? ResourceStorage::JSON : ResourceStorage::PACK);
+		if (auto value = json->find("negative_ttl"); value != json->end() && value->is_number_unsigned())
+			cache_config.negative_ttl = std::chrono::seconds{value->get<int64>()};
+		if (auto value = json->find("failure_threshold"); value != json->end() && value->is_number_unsigned())
+			cache_config.failure_threshold = value->get<uint32>();
+		if (auto value = json->find("backoff_min"); value != json->end() && value->is_number_unsigned())
+			cache_config.backoff_min = std::chrono::seconds{value->get<int64>()};
+		if (auto value = json->find("backoff_max"); value != json->end() && value->is_number_unsigned())
+			cache_config.backoff_max = std::chrono::seconds{value->get<int64>()};
+	}
+	return (cache_config);
+};
+
+constexpr auto read_prefetch_config = [](const dpp::json& config) -> PrefetchConfig
+{
+	PrefetchConfig prefetch_config;
+
+	if (auto json = config.find("api_prefetch"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("enabled"); value != json->end() && value->is_boolean())
+			prefetch_config.enabled = value->get<bool>();
+		if (auto value = json->find("requests_per_minute"); value != json->end() && value->is_number_unsigned())
+			prefetch_config.requests_per_minute = value->get<uint32>();
+		if (auto value = json->find("bytes_per_minute"); value != json->end() && value->is_number_unsigned())
+			prefetch_config.bytes_per_minute = value->get<size_t>();
+		if (auto value = json->find("max_requests"); value != json->end() && value->is_number_unsigned())
+			prefetch_config.max_requests = value->get<size_t>();
+	}
+	return (prefetch_config);
+};
+
+constexpr auto read_database_tuning = [](const dpp::json& config) -> DatabaseTuning
+{
+	DatabaseTuning tuning;
+
+	if (auto json = config.find("database"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("journal_mode"); value != json->end() && value->is_string())
+			tuning.journal_mode = value->get<std::string>();
+		if (auto value = json->find("synchronous"); value != json->end() && value->is_string())
+			tuning.synchronous = value->get<std::string>();
+		if (auto value = json->find("temp_store"); value != json->end() && value->is_string())
+			tuning.temp_store = value->get<std::string>();
+		if (auto value = json->find("mmap_size"); value != json->end() && value->is_number_unsigned())
+			tuning.mmap_size = value->get<int64>();
+		if (auto value = json->find("cache_size"); value != json->end() && value->is_number_integer())
+			tuning.cache_size = value->get<int64>();
+		if (auto value = json->find("busy_timeout_ms"); value != json->end() && value->is_number_unsigned())
+			tuning.busy_timeout = std::chrono::milliseconds{value->get<int64>()};
+		if (auto value = json->find("readers"); value != json->end() && value->is_number_unsigned())
+			tuning.readers = value->get<size_t>();
+		if (auto value = json->find("executors"); value != json->end() && value->is_number_unsigned())
+			tuning.executors = value->get<size_t>();
+	}
+	return (tuning);
+};
+
+constexpr auto read_write_behind_config = [](const dpp::json& config) -> WriteBehindConfig
+{
+	WriteBehindConfig write_config;
+
+	if (auto json = config.find("database"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("write_behind"); value != json->end() && value->is_boolean())
+			write_config.enabled = value->get<bool>();
+		if (auto value = json->find("max_batch"); value != json->end() && value->is_number_unsigned())
+			write_config.max_batch = value->get<size_t>();
+		if (auto value = json->find("max_delay_ms"); value != json->end() && value->is_number_unsigned())
+			write_config.max_delay = std::chrono::milliseconds{value->get<int64>()};
+	}
+	return (write_config);
+};
+
+constexpr auto read_backup_config = [](const dpp::json& config) -> BackupConfig
+{
+	BackupConfig backup_config;
+
+	if (auto json = config.find("database"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("backup"); value != json->end() && value->is_boolean())
+			backup_config.enabled = value->get<bool>();
+		if (auto value = json->find("backup_directory"); value != json->end() && value->is_string())
+			backup_config.directory = value->get<std::string>();
+		if (auto value = json->find("backup_interval_minutes"); value != json->end() && value->is_number_unsigned())
+			backup_config.interval = std::chrono::minutes{value->get<int64>()};
+		if (auto value = json->find("backup_keep"); value != json->end() && value->is_number_unsigned())
+			backup_config.keep = value->get<size_t>();
+	}
+	return (backup_config);
+};
+
+constexpr auto read_profiler_config = [](const dpp::json& config) -> ProfilerConfig
+{
+	ProfilerConfig profiler_config;
+
+	if (auto json = config.find("database"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("profile"); value != json->end() && value->is_boolean())
+			profiler_config.enabled = value->get<bool>();
+		if (auto value = json->find("slow_query_ms"); value != json->end() && value->is_number_unsigned())
+			profiler_config.slow_query = std::chrono::milliseconds{value->get<int64>()};
+		if (auto value = json->find("profiled_statements"); value != json->end() && value->is_number_unsigned())
+			profiler_config.max_statements = value->get<size_t>();
+	}
+	return (profiler_config);
+};
+
+constexpr auto read_data_store_config = [](const dpp::json& config) -> DataStoreConfig
+{
+	DataStoreConfig store_config;
+
+	if (auto json = config.find("database"); json != config.end() && json->is_object())
+	{
+		if (auto value = json->find("lazy_load"); value != json->end() && value->is_boolean())
+			store_config.lazy = value->get<bool>();
+		if (auto value = json->find("max_cached_rows"); value != json->end() && value->is_number_unsigned())
+			store_config.max_rows = value->get<size_t>();
+		if (auto value = json->find("warm_up"); value != json->end() && value->is_boolean())
+			store_config.warm_up = value->get<bool>();
+	}
+	return (store_config);
+};
+
 std::string Bot::_fetchToken(const char* console_arg) const
 {
 	if (console_arg)
@@ -103,7 +240,7 @@ Bot::Bot(const char* discord_token)
 		_bot->intents = dpp::intents::i_message_content | dpp::intents::i_guild_messages;
 		_bot->on_log(dpp_log);
 		log(LogLevel::BASIC, "Loading resource caches");
-		pokemon_cache = std::make_unique<PokeAPICache>(_bot.get());
+		pokemon_cache = std::make_unique<PokeAPICache>(_bot.get(), read_cache_config(_config), read_prefetch_config(_config));
 	}
 	catch (const std::exception& e)
 	{
@@ -202,20 +339,31 @@ bool Bot::_initDatabases()
 		// TODO: exception
 		return (false);
 	}
-	if (!_dbGlobalData.open(globalDbPath))
+	if (!_dbGlobalData.open(globalDbPath, read_database_tuning(_config)))
 	{
 		// TODO: better errors
 		log(LogLevel::ERROR, "could not load database");
 		return (false);
 	}
+	// coroutines awaiting the database go on in the thread pool of the cluster, not on the executors
+	_dbGlobalData.setResumer([cluster = _bot.get()](std::coroutine_handle<> handle)
+	{
+		cluster->queue_work(0, [handle]() { handle.resume(); });
+	});
+	_dbGlobalData.setProfiler(read_profiler_config(_config));
+	_dbGlobalData.setWriteBehind(read_write_behind_config(_config));
+	_dbGlobalData.setBackup(read_backup_config(_config));
 	log(LogLevel::BASIC, "database loaded");
 	return (true);
 }
 
 bool Bot::_initDatastores()
 {
-	DataStores::guild_settings.setDatabase(_dbGlobalData);
+	DataStores::guild_settings.setDatabase(_dbGlobalData, read_data_store_config(_config));
 
+	// lazy stores read their rows on first use
+	if (DataStores::guild_settings.isLazy())
+		return (true);
 	log(LogLevel::BASIC, "loading datastores");
 	DataStores::guild_settings.loadAll();
 	log(LogLevel::BASIC, "datastores loading complete");
@@ -350,6 +498,7 @@ int Bot::run()
 
 		log(LogLevel::BASIC, "Starting bot cluster...");
 		_bot->start(dpp::start_type::st_return);
+		pokemon_cache->prefetcher.start();
 	}
 	catch (const dpp::exception& e)
 	{
@@ -366,6 +515,10 @@ int Bot::run()
 		std::this_thread::sleep_for(std::chrono::milliseconds(20));
 	}
 	log(LogLevel::BASIC, "shutting down...");
+	pokemon_cache->prefetcher.stop();
+	DataStores::guild_settings.stopWarmUp();
+	_dbGlobalData.setBackup({});
+	_dbGlobalData.flush();
 	return (0);
 }
 
@@ -418,6 +571,8 @@ void Bot::_onReadyEvent(const dpp::ready_t &event)
 			);
 		}
 	}, 60);
+	// each shard knows its own guilds
+	DataStores::guild_settings.warmUp(event.guilds);
 	// TODO: cleanup
 	if (dpp::run_once<struct registerBotCommands>())
 	{
@@ -454,6 +609,39 @@ void Bot::_onReadyEvent(const dpp::ready_t &event)
 	}
 }
 
+bool Bot::isAdmin(dpp::snowflake user)
+{
+	const dpp::json& config = _s_instance->_config;
+
+	if (auto admins = config.find("admins"); admins != config.end() && admins->is_array())
+	{
+		for (const dpp::json& id : *admins)
+		{
+			if (!id.is_string())
+				continue;
+
+			const std::string& str   = id.get_ref<const std::string&>();
+			uint64             value = 0;
+
+			if (auto [end, err] = std::from_chars(str.data(), str.data() + str.size(), value); err == std::errc{} && value == user)
+				return (true);
+		}
+	}
+	return (false);
+}
+
+bool Bot::requestBackup()
+{
+	return (_s_instance->_dbGlobalData.requestBackup());
+}
+
+auto Bot::databaseProfile() -> std::optional<std::vector<QueryProfile>>
+{
+	if (!_s_instance->_dbGlobalData.isProfiling())
+		return (std::nullopt);
+	return (_s_instance->_dbGlobalData.profile());
+}
+
 auto Bot::fetchGuild(dpp::snowflake id) -> observer_ptr<Guild>
 {
 	auto& ptr = _s_instance->_guilds[id];
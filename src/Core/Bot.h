@@ -3,6 +3,7 @@
 #include <chrono>
 #include <exception>
 #include <filesystem>
+#include <optional>
 
 #include "../API/APICache.h"
 
@@ -78,6 +79,15 @@ namespace B12
 
 		static observer_ptr<Guild> fetchGuild(dpp::snowflake id);
 
+		// users listed in the "admins" array of the configuration
+		static bool isAdmin(dpp::snowflake user);
+
+		// snapshot of the global database, taken in the background
+		static bool requestBackup();
+
+		// what the profiler of the global database recorded, nothing if it is disabled
+		static auto databaseProfile() -> std::optional<std::vector<QueryProfile>>;
+
 		template <string_literal CommandName>
 		static CommandResponse command(
 			const dpp::interaction_create_t&          e,
@@ -7,10 +7,20 @@
 #include <shion/utils/owned_resource.h>
 #include <shion/utils/string_literal.h>
 
+#include <array>
+#include <bit>
 #include <chrono>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 #include <unordered_set>
+#include <vector>
 
 #include "B12.h"
 
@@ -20,10 +30,8 @@
 #include "DataStructures.h"
 
 /*
- * TODO: CLEANUP THIS FILE
- * this file is the first iteration of a succesful but incomplete attempt at serializing generic data structures into a database
- * a bit too spaghetti for my taste, it needs a rewrite
- * it's also missing using arbitrary key fields, right now it relies on the first field to be the primary key with a type of dpp::snowflake
+ * serializes the rows of a registry of DataFields into a table, with its queries generated at compile time
+ * rows are keyed by their PRIMARY_KEY fields, a single key field is the key itself, several make a tuple
  */
 
 extern "C"
@@ -97,6 +105,12 @@ namespace B12
 		constexpr inline auto sql_constraint_for_field_attr<FieldAttributeFlags::PRIMARY_KEY> =
 			""_sl; // " PRIMARY KEY"_sl;
 
+		template <>
+		constexpr inline auto sql_constraint_for_field_attr<FieldAttributeFlags::NOT_NULL> = " NOT NULL"_sl;
+
+		template <>
+		constexpr inline auto sql_constraint_for_field_attr<FieldAttributeFlags::UNIQUE> = " UNIQUE"_sl;
+
 		template <int flags>
 		struct data_store_attr_helper_s
 		{
@@ -119,6 +133,70 @@ namespace B12
 			static constexpr auto constraints =
 				data_store_attr_helper_s<T::FIELD_ATTRIBUTES>::getConstraint();
 		};
+
+		// the PRIMARY_KEY fields, one bit per field in declaration order
+		template <typename T, size_t... N>
+		consteval auto data_store_key_mask(std::index_sequence<N...>) -> uint64
+		{
+			return ((uint64{0} | ... |
+				(T::field_type_list::template at<N>::FIELD_ATTRIBUTES & FieldAttributeFlags::PRIMARY_KEY ? uint64{1} << N : uint64{0})));
+		}
+
+		template <typename T>
+		constexpr inline uint64 data_store_key_fields = data_store_key_mask<T>(std::make_index_sequence<T::key_list::size>());
+
+		// index of the I-th key field
+		template <typename T>
+		consteval auto data_store_key_field(size_t i) -> size_t
+		{
+			for (size_t n = 0; n < T::key_list::size; ++n)
+			{
+				if (((data_store_key_fields<T> >> n) & 1) && i-- == 0)
+					return (n);
+			}
+			return (T::key_list::size);
+		}
+
+		template <typename T, size_t... I>
+		auto data_store_key_type(std::index_sequence<I...>) -> std::conditional_t<
+			(sizeof...(I) == 1),
+			typename T::value_type_list::template at<data_store_key_field<T>(0)>,
+			std::tuple<typename T::value_type_list::template at<data_store_key_field<T>(I)>...>>;
+
+		template <typename T>
+		using data_store_key_t = decltype(data_store_key_type<T>(std::make_index_sequence<std::popcount(data_store_key_fields<T>)>()));
+
+		// an index of their own for INDEXED fields, then the ones declared with data_indexes
+		template <typename T, size_t... N>
+		auto data_store_indexes(std::index_sequence<N...>) -> decltype(std::tuple_cat(
+			std::declval<std::conditional_t<
+				(T::field_type_list::template at<N>::FIELD_ATTRIBUTES & FieldAttributeFlags::INDEXED) != 0,
+				std::tuple<DataIndex<T::key_list::template at<N>>>,
+				std::tuple<>>>()...,
+			std::declval<typename data_indexes<T>::type>()));
+
+		template <typename T>
+		using data_store_indexes_t = decltype(data_store_indexes<T>(std::make_index_sequence<T::key_list::size>()));
+
+		struct data_store_key_hash
+		{
+			template <typename Key>
+			size_t operator()(const Key& key) const
+			{
+				if constexpr (requires { std::tuple_size<Key>::value; })
+				{
+					return (std::apply([](const auto&... parts)
+					{
+						size_t hash = 0;
+
+						((hash ^= std::hash<std::decay_t<decltype(parts)>>{}(parts) + size_t{0x9e3779b9} + (hash << 6) + (hash >> 2)), ...);
+						return (hash);
+					}, key));
+				}
+				else
+					return (std::hash<Key>{}(key));
+			}
+		};
 	} // namespace _
 
 	template <typename T>
@@ -143,6 +221,14 @@ namespace B12
 		}
 	};
 
+	// how a DataStore keeps its rows in memory
+	struct DataStoreConfig
+	{
+		bool   lazy     = false; // rows are read on first use instead of all at boot
+		size_t max_rows = 0;     // when lazy, rows kept in memory, 0 means unbounded ; rows with a live Entry are never evicted
+		bool   warm_up  = false; // when lazy, rows of known IDs are read in the background with warmUp()
+	};
+
 	template <typename T, shion::string_literal Name>
 	class DataStore
 	{
@@ -151,6 +237,44 @@ namespace B12
 		using edit_entry = typename registry_edit_helper<entry_type>::type;
 		constexpr static auto name = Name;
 
+		constexpr static size_t field_count = T::key_list::size;
+
+		static_assert(field_count <= 64, "too many fields for the edited mask");
+
+		// one bit per field, in declaration order
+		using field_mask = std::conditional_t<(field_count <= 8), uint8,
+		                   std::conditional_t<(field_count <= 16), uint16,
+		                   std::conditional_t<(field_count <= 32), uint32, uint64>>>;
+
+		constexpr static field_mask all_fields =
+			(field_count == 64 ? ~field_mask{0} : static_cast<field_mask>((uint64{1} << field_count) - 1));
+
+		constexpr static field_mask key_fields = static_cast<field_mask>(_::data_store_key_fields<T>);
+		constexpr static size_t     key_count  = std::popcount(_::data_store_key_fields<T>);
+
+		static_assert(key_count > 0, "a data store needs a PRIMARY_KEY field");
+
+		// the field itself for a single key field, a tuple of them in declaration order for a composite key
+		using key_type = _::data_store_key_t<T>;
+
+		using indexes = _::data_store_indexes_t<T>;
+
+		template <shion::string_literal Field>
+		using field_type = std::remove_cvref_t<decltype(std::declval<const T&>().template get<Field>())>;
+
+		// what an index is looked up by : the field itself for a single field, a tuple of them otherwise
+		template <shion::string_literal... Fields>
+		using index_value = std::conditional_t<
+			(sizeof...(Fields) == 1),
+			std::tuple_element_t<0, std::tuple<field_type<Fields>...>>,
+			std::tuple<field_type<Fields>...>>;
+
+		template <typename Index>
+		constexpr static bool has_index = []<typename... Is>(std::type_identity<std::tuple<Is...>>)
+		{
+			return ((std::is_same_v<Index, Is> || ...));
+		}(std::type_identity<indexes>{});
+
 		// the interface to change data within an entry
 		// writes on destroy
 		struct Entry : public edit_entry
@@ -160,163 +284,742 @@ namespace B12
 			~Entry()
 			{
 				_data_store.save(*this);
+				_data_store._unpin(_keyOf(_entry));
+			}
+
+			field_mask editedMask() const
+			{
+				return (_editedMask(std::make_index_sequence<field_count>()));
 			}
 
 		protected:
 			friend class DataStore<T, Name>;
 
-			Entry(DataStore& dataStore, entry_type& entry, bool is_new) :
+			Entry(DataStore& dataStore, entry_type& entry) :
 				edit_entry(registry_edit_helper<entry_type>::get(entry)),
 				_data_store(dataStore),
-				_is_new(is_new) {}
+				_entry(entry) {}
 
 			Entry()             = delete;
 			Entry(const Entry&) = delete;
 			Entry(Entry&&)      = delete;
 
-			DataStore& _data_store;
-			bool       _is_new{false};
+			DataStore&        _data_store;
+			const entry_type& _entry;
 
-			// populates a DatabaseStatement with an update query
+			// populates a statement with the upsert of the edited fields
 			// returns true on success, false on error
-			// stmt is unchanged at the end if no fields need updating
-			bool fillUpdateStatement(DatabaseStatement& stmt) const
+			// stmt is unchanged at the end if no fields need saving
+			bool fillUpsertStatement(CachedStatement& stmt) const
 			{
-				std::stringstream queryStream;
-				constexpr auto    primaryKey = edit_entry::key_list::template at<0>;
-				constexpr auto    idxSeq = std::make_index_sequence<edit_entry::field_type_list::size>();
-				UpdateHelper      helper{*this};
+				field_mask edited = editedMask();
 
-				queryStream << std::string_view(shion::literal_concat("UPDATE ", Name, " SET"));
-				helper.fillFieldRelationalList(queryStream, idxSeq);
-				if (!helper.num_edited_fields) // no fields to update
+				if (!edited) // no fields to save
 					return (true);
-				queryStream << std::string_view(
-					shion::literal_concat("\nWHERE ", primaryKey, " = ?")
-				);
+				return (_data_store._fillUpsertStatement(stmt, _entry, edited));
+			}
+
+			// the changes are saved, or queued to be
+			void markClean() const
+			{
+				_markClean(std::make_index_sequence<field_count>());
+			}
+
+		private:
+			template <size_t... N>
+			field_mask _editedMask(std::index_sequence<N...>) const
+			{
+				return ((field_mask{0} | ... |
+					(this->template get<edit_entry::key_list::template at<N>>().edited ? static_cast<field_mask>(field_mask{1} << N) : field_mask{0})));
+			}
+
+			template <size_t... N>
+			void _markClean(std::index_sequence<N...>) const
+			{
+				((this->template get<edit_entry::key_list::template at<N>>().edited = false), ...);
+			}
+		};
+
+		Entry get(const key_type& id)
+		{
+			std::unique_lock  lock{_data_mutex};
+			CachedRow&        slot  = _fetch(id, lock);
+			std::optional<T>& entry = slot.row;
+
+			if (!entry.has_value())
+			{
+				entry = T();
+				_setKey(*entry, id, std::make_index_sequence<key_count>());
+				_indexRow(id, *entry);
+			}
+			_pin(slot);
+			return {*this, entry.value()};
+		};
+
+		// a copy, in lazy mode the row may be evicted once the lock is released
+		std::optional<T> operator[](const key_type& id)
+		{
+			std::unique_lock lock{_data_mutex};
+
+			return (_fetch(id, lock).row);
+		}
+
+		// writes the entry, or queues it when the database is in write-behind mode
+		bool save(const Entry& data);
+
+		// keys of the rows whose fields hold these values, through the index declared over these fields
+		// in lazy mode the rows that are not in memory are looked up in the database, which uses its own index
+		template <shion::string_literal... Fields>
+		std::vector<key_type> findBy(const index_value<Fields...>& value)
+		{
+			using index = SecondaryIndex<DataIndex<Fields...>>;
+
+			static_assert(has_index<DataIndex<Fields...>>, "no index is declared over these fields");
+
+			std::unordered_set<key_type, _::data_store_key_hash> found;
+
+			// a queued row committed during the read may be in neither the read nor _pending, it is read again then
+			for (uint64 commits = ~uint64{0}; _config.lazy && _database && commits != _pendingCommits();)
+			{
+				commits = _pendingCommits();
+				found.clear();
+				for (key_type& id : _selectBy<Fields...>(value))
+					found.insert(std::move(id));
+
+				// queued writes are newer than the database
+				std::unique_lock lock{_pending_mutex};
+
+				for (const auto& [id, pending] : _pending)
+				{
+					if (index::valueOf(pending.row) == value)
+						found.insert(id);
+					else
+						found.erase(id);
+				}
+			}
+
+			std::unique_lock lock{_data_mutex};
+			const index&     rows = std::get<index>(_indexes);
+
+			// and rows in memory are newer than both
+			std::erase_if(found, [&](const key_type& id)
+			{
+				auto it = rows.values.find(id);
+
+				return (it != rows.values.end() && !(it->second == value));
+			});
+			if (auto it = rows.keys.find(value); it != rows.keys.end())
+				found.insert(it->second.begin(), it->second.end());
+			return {found.begin(), found.end()};
+		}
+
+		// the following run on the executor threads of the database, a coroutine co_awaits them instead of blocking its thread
+
+		// the edited fields are copied and the entry marked clean on the calling thread, only the copy is written
+		// with write-behind, the write is queued right away and the task is already done
+		auto saveAsync(const Entry& entry) -> DatabaseTask<bool>;
+
+		auto findAsync(key_type id) -> DatabaseTask<std::optional<T>>
+		{
+			return (_async([this, id = std::move(id)]() { return ((*this)[id]); }));
+		}
+
+		template <shion::string_literal... Fields>
+		auto findByAsync(index_value<Fields...> value) -> DatabaseTask<std::vector<key_type>>
+		{
+			return (_async([this, value = std::move(value)]() { return (findBy<Fields...>(value)); }));
+		}
+
+		auto loadManyAsync(std::vector<key_type> ids) -> DatabaseTask<bool>
+		{
+			return (_async([this, ids = std::move(ids)]() { return (loadMany(ids)); }));
+		}
+
+		// creates the table, or migrates it to the fields of T
+		void setDatabase(Database& db, DataStoreConfig config = {})
+		{
+			static constexpr auto create_query = _generateCreateTableQuery();
+			static constexpr auto columns      = _getColumns(std::make_index_sequence<field_count>());
+			static constexpr auto index_list   = _getIndexes(std::type_identity<indexes>{});
+
+			_database = &db;
+			_config   = config;
+			if (!_database->migrate({Name, create_query, columns, index_list}))
+				B12::log(LogLevel::ERROR, "{}: could not migrate the table to its schema", Name.data);
+		}
+
+		bool isLazy() const noexcept
+		{
+			return (_config.lazy);
+		}
+
+		// while the table is rebuilt, the rows left in the old table are read first, rows moved since replace them
+		bool loadAll()
+		{
+			static constexpr auto columns = _getColumns(std::make_index_sequence<field_count>());
+
+			constexpr auto query     = _generateSelectQuery();
+			std::string    old_query = _database->migratingSelect(Name, columns);
+			DatabaseReader reader    = _database->reader();
+
+			// the old table is dropped once the rebuild is over, its rows are all in the new one by then
+			if (!old_query.empty() && !_loadAllFrom(reader, old_query) && _database->isMigrating(Name))
+				return (false);
+			return (_loadAllFrom(reader, query));
+		}
+
+		// writes whole rows in one transaction, overwriting what the database held for them, then keeps them in memory
+		// nothing is written if one of them fails
+		template <std::ranges::forward_range R>
+			requires (std::convertible_to<std::ranges::range_reference_t<R>, const T&>)
+		bool saveMany(R&& rows)
+		{
+			constexpr auto query = _upsert_query<all_fields>;
+
+			if (!_database)
+				return (false);
+
+			{
+				// queued writes of these rows are older than them
+				std::unique_lock lock{_pending_mutex};
+
+				for (const T& row : rows)
+					_pending.erase(_keyOf(row));
+			}
+
+			bool success = _database->transaction([&]()
+			{
+				CachedStatement stmt = _database->statement(query);
 
-				stmt = _data_store._database->prepare(queryStream.str());
 				if (!stmt.hasResource())
 					return (false);
-				if (!helper.bindParameters(stmt, idxSeq))
-					return (false);
-				if (!stmt.bind(this->template get<primaryKey>()))
-					return (false);
+				for (const T& row : rows)
+				{
+					if (!_bindFields(*stmt, row, all_fields) || !stmt->exec())
+						return (false);
+					stmt->reset();
+				}
 				return (true);
+			});
+
+			if (!success)
+				return (false);
+
+			std::unique_lock lock{_data_mutex};
+
+			for (const T& row : rows)
+			{
+				key_type id = _keyOf(row);
+
+				_slot(id).first.row = row;
+				_indexRow(id, row);
 			}
+			return (true);
+		}
+
+		// reads the rows of these IDs into memory, a few statements for all of them
+		// rows already in memory are kept as they are, IDs the database does not have are skipped
+		// this reads through a reader connection, queued writes not committed yet are taken from _pending instead
+		template <std::ranges::input_range R>
+			requires (std::convertible_to<std::ranges::range_reference_t<R>, const key_type&>)
+		bool loadMany(R&& ids)
+		{
+			constexpr auto query = _generateSelectManyQuery();
+
+			if (!_database)
+				return (false);
 
-			bool fillInsertStatement(DatabaseStatement& stmt) const
+			DatabaseReader                      reader = _database->reader();
+			CachedStatement                     stmt   = reader.statement(query);
+			std::array<key_type, LOAD_MANY_IDS> chunk;
+			size_t                              count  = 0;
+
+			if (!stmt.hasResource())
+				return (false);
+
+			auto load_chunk = [&]()
 			{
-				constexpr auto query = _generateInsertQuery();
+				if (_database->isMigrating(Name))
+				{
+					for (size_t i = 0; i < count; ++i)
+						_copyMigrating(chunk[i]);
+				}
+				std::array<uint64, LOAD_MANY_IDS>   evictions;
+				std::vector<std::pair<key_type, T>> loaded;
+				bool                                done = false;
 
-				stmt = _data_store._database->prepare(query);
+				{
+					std::unique_lock lock{_data_mutex};
 
-				if (!stmt.resource)
-					return (false);
-				if (!_bindAll(stmt, std::make_index_sequence<edit_entry::field_type_list::size>()))
+					for (size_t i = 0; i < count; ++i)
+						evictions[i] = _startLoading(chunk[i]);
+				}
+
+				// the rows are read with the lock released, then installed where no other thread did first
+				// a queued row committed during the read may be in neither the read nor _pending, the chunk is read again then
+				for (uint64 commits = ~uint64{0}; commits != _pendingCommits();)
+				{
+					commits = _pendingCommits();
+					loaded.clear();
+					for (size_t i = 0; i < count; ++i)
+					{
+						if (std::optional<T> pending = _pendingRow(chunk[i]))
+							loaded.emplace_back(chunk[i], std::move(*pending));
+					}
+					// unused placeholders repeat the last ID
+					bool bound = true;
+
+					for (size_t i = 0; i < LOAD_MANY_IDS && bound; ++i)
+						bound = _bindKey(*stmt, chunk[std::min(i, count - 1)], std::make_index_sequence<key_count>());
+					if (!bound)
+					{
+						stmt->reset();
+						done = false;
+						break;
+					}
+
+					auto rows = stmt->rows();
+
+					for (const DatabaseRow& row : rows)
+					{
+						auto& [id, entry] = loaded.emplace_back(_readKey(row), T());
+
+						_loadFields(row, entry, std::make_index_sequence<T::key_list::size>());
+					}
+					done = rows.done();
+					stmt->reset();
+					if (!done)
+						break;
+				}
+
+				std::unordered_set<key_type, _::data_store_key_hash> evicted;
+				std::unique_lock                                      lock{_data_mutex};
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (!_stopLoading(chunk[i], evictions[i]))
+						evicted.insert(chunk[i]);
+				}
+				for (auto& [id, row] : loaded)
+				{
+					// evicted in the meantime, it may have been edited since it was read
+					if (evicted.contains(id))
+						continue;
+
+					std::optional<T>& entry = _slot(id).first.row;
+
+					if (entry.has_value())
+						continue;
+					if (std::optional<T> pending = _pendingRow(id))
+						entry = std::move(pending);
+					else
+						entry = std::move(row);
+					_indexRow(id, *entry);
+				}
+				lock.unlock();
+				count = 0;
+				return (done);
+			};
+
+			for (const key_type& id : ids)
+			{
+				if (_isLoaded(id))
+					continue;
+				chunk[count++] = id;
+				if (count == LOAD_MANY_IDS && !load_chunk())
 					return (false);
-				return (true);
 			}
+			if (count && !load_chunk())
+				return (false);
+			return (true);
+		}
 
-		private:
-			struct UpdateHelper
+		// reads the rows of these IDs in the background, while there is room for them in memory
+		// meant to run once the bot is connected and knows its guilds
+		void warmUp(std::vector<key_type> ids)
+		{
+			if (!_config.lazy || !_config.warm_up || !_database || ids.empty())
+				return;
+
+			std::unique_lock lock{_warm_up_mutex};
+
+			_warm_ups.emplace_back([this, ids = std::move(ids)](std::stop_token stop)
 			{
-				template <size_t N>
-				bool bindParameters(DatabaseStatement& statement) const
+				for (size_t i = 0; i < ids.size() && !stop.stop_requested() && !_isFull(); i += LOAD_MANY_IDS)
 				{
-					constexpr auto key   = edit_entry::key_list::template at<N>;
-					const auto&    field = entry.template get<key>();
+					std::span<const key_type> chunk{ids.data() + i, std::min(LOAD_MANY_IDS, ids.size() - i)};
 
-					if (!field.edited)
-						return {true};
-					return {statement.bind(field.value)};
+					if (!loadMany(chunk))
+					{
+						B12::log(LogLevel::ERROR, "{}: warm-up stopped after {} of {} rows", Name.data, i, ids.size());
+						return;
+					}
 				}
+			});
+		}
+
+		// must be called before the database closes
+		void stopWarmUp()
+		{
+			std::unique_lock lock{_warm_up_mutex};
+
+			_warm_ups.clear();
+		}
+
+	private:
+		// IDs looked up by each statement of loadMany
+		constexpr static size_t LOAD_MANY_IDS = 64;
+
+		// snapshot of a row waiting for the database's writer thread
+		// it stays until its statement ran, so lookups never read an older row from the database
+		struct PendingWrite
+		{
+			T                                                          row;
+			field_mask                                                 edited;
+			bool                                                       writing = false;
+			std::vector<std::shared_ptr<_::database_task_state<bool>>> followers = {}; // saveAsync calls carried by the queued write
+		};
 
-				template <size_t... N>
-				bool bindParameters(DatabaseStatement& statement, std::index_sequence<N...>) const
+		struct CachedRow
+		{
+			std::optional<T>                             row; // empty if the database does not have it
+			size_t                                       pins = 0; // live entries, only counted when rows can be evicted
+			typename std::list<key_type>::iterator lru;      // position in _lru while unpinned
+		};
+
+		// a row read with _data_mutex released
+		struct LoadingRow
+		{
+			size_t loaders   = 0;
+			uint64 evictions = 0; // times it was evicted since the first of its loaders started
+		};
+
+		// the rows in memory by the values of their fields in an index, kept in step with _data
+		template <typename Index>
+		struct SecondaryIndex;
+
+		template <shion::string_literal First, shion::string_literal... Rest>
+		struct SecondaryIndex<DataIndex<First, Rest...>>
+		{
+			using value_type = index_value<First, Rest...>;
+
+			constexpr static auto name    = shion::literal_concat(Name, "__", First, shion::literal_concat("__", Rest)...);
+			constexpr static auto columns = shion::literal_concat(First, shion::literal_concat(", ", Rest)...);
+			constexpr static auto select_query = shion::literal_concat(
+				DataStore::_generateSelectQuery(),
+				"\nWHERE\n\t",
+				First,
+				" = ?",
+				shion::literal_concat(" AND\n\t", Rest, " = ?")...);
+
+			static value_type valueOf(const T& row)
+			{
+				return {row.template get<First>(), row.template get<Rest>()...};
+			}
+
+			static bool bindValue(DatabaseStatement& stmt, const value_type& value)
+			{
+				if constexpr (sizeof...(Rest) == 0)
+					return (stmt.bind(value));
+				else
+					return (std::apply([&stmt](const auto&... parts) { return ((stmt.bind(parts) && ...)); }, value));
+			}
+
+			void set(const key_type& id, const T& row)
+			{
+				value_type value    = valueOf(row);
+				auto [it, inserted] = values.try_emplace(id, value);
+
+				if (!inserted)
 				{
-					if (!(true && ... && bindParameters<N>(statement)))
-						return (false);
-					return (true);
+					if (it->second == value)
+						return;
+					_eraseKey(it->second, id);
+					it->second = value;
 				}
+				keys[std::move(value)].insert(id);
+			}
 
-				template <size_t N>
-				constexpr void fillFieldRelational(std::stringstream& oss)
+			void erase(const key_type& id)
+			{
+				if (auto it = values.find(id); it != values.end())
 				{
-					constexpr auto key = edit_entry::key_list::template at<N>;
+					_eraseKey(it->second, id);
+					values.erase(it);
+				}
+			}
 
-					if (!entry.template get<key>().edited)
-						return;
+			std::unordered_map<value_type, std::unordered_set<key_type, _::data_store_key_hash>, _::data_store_key_hash> keys;
+			std::unordered_map<key_type, value_type, _::data_store_key_hash>                                              values;
+
+		private:
+			void _eraseKey(const value_type& value, const key_type& id)
+			{
+				if (auto it = keys.find(value); it != keys.end() && it->second.erase(id) && it->second.empty())
+					keys.erase(it);
+			}
+		};
+
+		template <typename Indexes>
+		struct SecondaryIndexes;
+
+		template <typename... Is>
+		struct SecondaryIndexes<std::tuple<Is...>>
+		{
+			using type = std::tuple<SecondaryIndex<Is>...>;
+		};
+
+		template <typename... Is>
+		static consteval auto _getIndexes(std::type_identity<std::tuple<Is...>>) -> std::array<IndexSchema, sizeof...(Is)>
+		{
+			return {IndexSchema{SecondaryIndex<Is>::name, SecondaryIndex<Is>::columns}...};
+		}
+
+		// reads through a reader connection like lazy lookups ; rows still in the old table of a rebuild are not indexed yet
+		template <shion::string_literal... Fields>
+		std::vector<key_type> _selectBy(const index_value<Fields...>& value)
+		{
+			using index = SecondaryIndex<DataIndex<Fields...>>;
+
+			std::vector<key_type> ids;
+
+			_database->waitMigration(Name);
+
+			DatabaseReader  reader = _database->reader();
+			CachedStatement stmt   = reader.statement(index::select_query);
+
+			if (!stmt.hasResource() || !index::bindValue(*stmt, value))
+				return (ids);
+
+			auto rows = stmt->rows();
+
+			for (const DatabaseRow& row : rows)
+				ids.push_back(_readKey(row));
+			if (!rows.done())
+				B12::log(LogLevel::ERROR, "{}: could not look up rows by index {}", Name.data, index::name.data);
+			return (ids);
+		}
+
+		void _reindex(const T& row)
+		{
+			if constexpr (std::tuple_size_v<indexes> > 0)
+			{
+				std::unique_lock lock{_data_mutex};
+
+				_indexRow(_keyOf(row), row);
+			}
+		}
+
+		// without a database, jobs only touch memory and run right away
+		template <typename Fn>
+		auto _async(Fn&& fn) -> DatabaseTask<std::invoke_result_t<std::decay_t<Fn>&>>
+		{
+			if (!_database)
+				return (DatabaseTask<std::invoke_result_t<std::decay_t<Fn>&>>::done(std::invoke(fn)));
+			return (_database->async(std::forward<Fn>(fn)));
+		}
+
+		bool _queueWrite(const Entry& entry)
+		{
+			field_mask edited = entry.editedMask();
+
+			if (!edited)
+				return (true);
+
+			key_type id = _keyOf(entry._entry);
+
+			// the row is already queued, the queued write will carry the new values
+			if (!_stageWrite(entry, id, edited))
+				return (true);
+			return (_database->write([this, id]() { return (_writePending(id)); }, [this, id]() { _commitPending(id); }));
+		}
+
+		// copies the edited fields of the entry into _pending and marks the entry clean
+		// returns false if a write of the row is queued and not running yet, it will carry them and complete follower
+		bool _stageWrite(const Entry& entry, const key_type& id, field_mask edited, std::shared_ptr<_::database_task_state<bool>> follower = {})
+		{
+			std::unique_lock lock{_pending_mutex};
+			auto [it, inserted] = _pending.try_emplace(id, PendingWrite{entry._entry, edited});
+
+			entry.markClean();
+			if (inserted)
+				return (true);
+			it->second.row = entry._entry;
+			it->second.edited |= edited;
+			if (!it->second.writing)
+			{
+				if (follower)
+					it->second.followers.push_back(std::move(follower));
+				return (false);
+			}
+			// the running write has older values, another one is needed
+			it->second.writing = false;
+			return (true);
+		}
+
+		// the row stays in _pending until _commitPending, reads from other connections do not see it before
+		bool _writePending(const key_type& id)
+		{
+			std::unique_lock lock{_pending_mutex};
+			auto             it = _pending.find(id);
+
+			if (it == _pending.end() || it->second.writing)
+				return (true);
+			it->second.writing = true;
+
+			PendingWrite pending = it->second;
+
+			it->second.followers.clear();
+			lock.unlock();
+
+			bool success = _writeRow(pending);
+
+			for (auto& follower : pending.followers)
+				follower->complete(success);
+			return (success);
+		}
+
+		// unless the row was staged again since it was written
+		void _commitPending(const key_type& id)
+		{
+			std::unique_lock lock{_pending_mutex};
+
+			if (auto it = _pending.find(id); it != _pending.end() && it->second.writing)
+			{
+				_pending.erase(it);
+				++_commits;
+			}
+		}
+
+		uint64 _pendingCommits()
+		{
+			std::unique_lock lock{_pending_mutex};
+
+			return (_commits);
+		}
+
+		std::optional<T> _pendingRow(const key_type& id)
+		{
+			std::unique_lock lock{_pending_mutex};
+
+			if (auto it = _pending.find(id); it != _pending.end())
+				return (it->second.row);
+			return {};
+		}
+
+		bool _writeRow(const PendingWrite& pending)
+		{
+			CachedStatement stmt;
+
+			if (!_fillUpsertStatement(stmt, pending.row, pending.edited))
+				return (false);
+			return (stmt->exec());
+		}
 
-					constexpr auto line = shion::literal_concat("\n\t", _getFieldName<N>(), " = ?");
+		// the row is inserted whole, or only its edited fields overwrite the row in the database
+		bool _fillUpsertStatement(CachedStatement& stmt, const T& row, field_mask edited)
+		{
+			stmt = _database->statement(_upsertQuery(_upsertFields(edited)));
+			if (!stmt.hasResource())
+				return (false);
+			if (!_bindFields(*stmt, row, all_fields))
+				return (false);
+			return (true);
+		}
 
-					num_edited_fields++;
-					if (oss.tellp() != std::streampos(0))
-						oss << ", ";
-					oss << std::string_view(line);
-				}
+		template <size_t... N>
+		static bool _bindFields(DatabaseStatement& stmt, const T& row, field_mask fields, std::index_sequence<N...>)
+		{
+			return ((true && ... && (!(fields & (field_mask{1} << N)) || stmt.bind(row.template get<T::key_list::template at<N>>()))));
+		}
 
-				template <size_t... N>
-				void fillFieldRelationalList(std::stringstream& oss, std::index_sequence<N...>)
-				{
-					std::stringstream ss;
+		static bool _bindFields(DatabaseStatement& stmt, const T& row, field_mask fields)
+		{
+			return (_bindFields(stmt, row, fields, std::make_index_sequence<field_count>()));
+		}
 
-					(fillFieldRelational<N>(ss), ...);
-					oss << std::move(ss.str());
-				}
+		// every combination of edited fields has its upsert text generated when there are few fields,
+		// otherwise only single fields do and other combinations overwrite the whole row
+		constexpr static bool all_upsert_variants = (field_count <= 6);
 
-				const Entry& entry;
-				int          num_edited_fields{0};
-			};
+		static field_mask _upsertFields(field_mask edited)
+		{
+			if constexpr (all_upsert_variants)
+				return (edited);
+			else
+				return (std::has_single_bit(edited) ? edited : all_fields);
+		}
 
-			template <size_t N>
-			bool _bindAll(DatabaseStatement& statement) const
+		static std::string_view _upsertQuery(field_mask fields)
+		{
+			if constexpr (all_upsert_variants)
 			{
-				constexpr auto key   = edit_entry::key_list::template at<N>;
-				const auto&    entry = this->template get<key>();
+				static constexpr auto queries = _upsertQueries(std::make_index_sequence<size_t{1} << field_count>());
 
-				return {statement.bind(entry.value)};
+				return (queries[fields]);
 			}
-
-			template <size_t... N>
-			bool _bindAll(DatabaseStatement& statement, std::index_sequence<N...>) const
+			else
 			{
-				return {(true && ... && _bindAll<N>(statement))};
+				static constexpr auto queries = _upsertQueries(std::make_index_sequence<field_count>(), true);
+				static constexpr auto full    = _upsert_query<all_fields>;
+
+				if (fields == all_fields)
+					return (full);
+				return (queries[std::countr_zero(fields)]);
 			}
-		};
+		}
 
-		Entry get(dpp::snowflake id)
+		template <field_mask Fields>
+		consteval static auto _generateUpsertQuery()
 		{
-			std::optional<T>& entry = _fetch(id);
-
-			if (entry.has_value())
-				return {*this, entry.value(), false};
-			entry                                     = T();
-			entry.value().template get<"snowflake">() = id;
-			return {*this, entry.value(), true};
-		};
+			constexpr auto   idxSeq     = std::make_index_sequence<T::key_list::size>();
+			constexpr auto   keyList    = GeneralQueryHelper::_getKeyList(std::make_index_sequence<key_count>());
+			constexpr uint64 set_fields = Fields & ~key_fields;
 
-		const std::optional<T> &operator[](dpp::snowflake id)
-		{
-			return (_fetch(id));
+			if constexpr (set_fields == 0)
+			{
+				return (shion::literal_concat(
+					_generateInsertQuery(),
+					"\nON CONFLICT (",
+					keyList,
+					") DO NOTHING;"));
+			}
+			else
+			{
+				return (shion::literal_concat(
+					_generateInsertQuery(),
+					"\nON CONFLICT (",
+					keyList,
+					") DO UPDATE SET",
+					GeneralQueryHelper::template _getExcludedList<set_fields>(idxSeq),
+					";"));
+			}
 		}
 
-		bool save(const Entry& data);
+		template <field_mask Fields>
+		constexpr static auto _upsert_query = _generateUpsertQuery<Fields>();
 
-		void setDatabase(Database& db)
+		template <field_mask Fields>
+		static consteval auto _upsertQueryView() -> std::string_view
 		{
-			_database = &db;
-			_database->exec(_generateCreateTableQuery());
+			if constexpr (Fields == 0)
+				return {};
+			else
+				return (_upsert_query<Fields>);
 		}
 
-		bool loadAll()
+		template <size_t... N>
+		static consteval auto _upsertQueries(std::index_sequence<N...>) -> std::array<std::string_view, sizeof...(N)>
 		{
-			DatabaseStatement stmt = _database->prepare(_generateSelectQuery());
+			return {_upsertQueryView<static_cast<field_mask>(N)>()...};
+		}
 
-			return (stmt.exec(_loadCallback));
+		template <size_t... N>
+		static consteval auto _upsertQueries(std::index_sequence<N...>, bool) -> std::array<std::string_view, sizeof...(N)>
+		{
+			return {_upsertQueryView<static_cast<field_mask>(field_mask{1} << N)>()...};
 		}
 
-	private:
 		struct GeneralQueryHelper
 		{
 			template <size_t N, bool condition = true>
@@ -387,40 +1090,86 @@ namespace B12
 				return (shion::literal_concat(_getFieldRelational<N>()...));
 			}
 
-			template <size_t N>
-			constexpr static auto _attributes = T::field_type_list::template at<N>::FIELD_ATTRIBUTES;
+			// "field = excluded.field" for the fields in the mask, separated by commas
+			template <auto Fields, size_t N>
+			static consteval auto _getExcludedRelational()
+			{
+				constexpr bool selected = (Fields >> N) & 1;
+				constexpr bool first    = (N == 0 || (Fields & ((uint64{1} << N) - 1)) == 0);
 
-			template <size_t... N>
-			static consteval auto _getWhereClause(std::index_sequence<N...>)
+				constexpr auto line = shion::literal_concat("\n\t", _getFieldName<N>(), " = excluded.", _getFieldName<N>());
+
+				if constexpr (!selected)
+					return (shion::string_literal(""));
+				else if constexpr (!first)
+					return (shion::literal_concat(",", line));
+				else
+					return (line);
+			}
+
+			template <auto Fields, size_t... N>
+			static consteval auto _getExcludedList(std::index_sequence<N...>)
 			{
-				constexpr int num_keys =
-					(0 + ... + (_attributes<N> & FieldAttributeFlags::PRIMARY_KEY ? 1 : 0));
+				return (shion::literal_concat(_getExcludedRelational<Fields, N>()...));
+			}
 
-				static_assert(num_keys == 1);
-				return (shion::literal_concat(
-					"\nWHERE",
-					shion::literal_concat(
-						(_getFieldRelational<
-							N,
-							_attributes<N> & FieldAttributeFlags::PRIMARY_KEY,
-							false>()
-						)...
-					)
-				));
+			// the I-th key field
+			template <size_t I>
+			static consteval auto _getKeyName()
+			{
+				return (_getFieldName<_::data_store_key_field<T>(I)>());
 			}
-		};
 
-		constexpr static auto _generateUpdateQuery()
-		{
-			constexpr auto idxSeq = std::make_index_sequence<T::key_list::size>();
+			template <size_t I>
+			static consteval auto _getKeyNameWithComma()
+			{
+				if constexpr (I == 0)
+					return (_getKeyName<I>());
+				else
+					return (shion::literal_concat(", ", _getKeyName<I>()));
+			}
 
-			return (shion::literal_concat(
-				"UPDATE ",
-				Name,
-				" SET ",
-				GeneralQueryHelper::_getFieldRelationalList(idxSeq),
-				GeneralQueryHelper::_getWhereClause(idxSeq)));
-		}
+			template <size_t... I>
+			static consteval auto _getKeyList(std::index_sequence<I...>)
+			{
+				return (shion::literal_concat(_getKeyNameWithComma<I>()...));
+			}
+
+			template <size_t I>
+			static consteval auto _getKeyRelational()
+			{
+				constexpr auto line = shion::literal_concat("\n\t", _getKeyName<I>(), " = ?");
+
+				if constexpr (I == 0)
+					return (line);
+				else
+					return (shion::literal_concat(" AND", line));
+			}
+
+			template <size_t... I>
+			static consteval auto _getWhereClause(std::index_sequence<I...>)
+			{
+				return (shion::literal_concat("\nWHERE", _getKeyRelational<I>()...));
+			}
+
+			// one row value of key placeholders per N
+			template <size_t N>
+			static consteval auto _getKeyPlaceholders()
+			{
+				constexpr auto row = shion::literal_concat("(", _getFieldPlaceholders(std::make_index_sequence<key_count>()), ")");
+
+				if constexpr (N == 0)
+					return (row);
+				else
+					return (shion::literal_concat(", ", row));
+			}
+
+			template <size_t... N>
+			static consteval auto _getKeyPlaceholdersList(std::index_sequence<N...>)
+			{
+				return (shion::literal_concat(_getKeyPlaceholders<N>()...));
+			}
+		};
 
 		constexpr static auto _generateSelectQuery()
 		{
@@ -442,12 +1191,234 @@ namespace B12
 				GeneralQueryHelper::_getFieldList(idxSeq),
 				")\nVALUES (",
 				GeneralQueryHelper::_getFieldPlaceholders(idxSeq),
-				");"));
+				")"));
+		}
+
+		consteval static auto _generateSelectOneQuery()
+		{
+			constexpr auto keySeq = std::make_index_sequence<key_count>();
+
+			return (shion::literal_concat(_generateSelectQuery(), GeneralQueryHelper::_getWhereClause(keySeq)));
+		}
+
+		consteval static auto _generateSelectManyQuery()
+		{
+			constexpr auto keySeq = std::make_index_sequence<key_count>();
+			constexpr auto idSeq  = std::make_index_sequence<LOAD_MANY_IDS>();
+
+			if constexpr (key_count == 1)
+			{
+				return (shion::literal_concat(
+					_generateSelectQuery(),
+					"\nWHERE ",
+					GeneralQueryHelper::_getKeyList(keySeq),
+					" IN (",
+					GeneralQueryHelper::_getFieldPlaceholders(idSeq),
+					")"));
+			}
+			else
+			{
+				// composite keys are compared as row values
+				return (shion::literal_concat(
+					_generateSelectQuery(),
+					"\nWHERE (",
+					GeneralQueryHelper::_getKeyList(keySeq),
+					") IN (VALUES ",
+					GeneralQueryHelper::_getKeyPlaceholdersList(idSeq),
+					")"));
+			}
+		}
+
+		bool _isEvictable() const noexcept
+		{
+			return (_config.lazy && _config.max_rows != 0);
+		}
+
+		bool _isFull()
+		{
+			std::unique_lock lock{_data_mutex};
+
+			return (_config.max_rows != 0 && _data.size() >= _config.max_rows);
+		}
+
+		bool _isLoaded(const key_type& id)
+		{
+			std::unique_lock lock{_data_mutex};
+			auto             it = _data.find(id);
+
+			return (it != _data.end() && it->second.row.has_value());
+		}
+
+		// the following take _data_mutex locked
+
+		// the slot of a row and whether it was just created, empty
+		std::pair<CachedRow&, bool> _slot(const key_type& id)
+		{
+			auto [it, inserted] = _data.try_emplace(id);
+			CachedRow& slot     = it->second;
+
+			if (_isEvictable())
+			{
+				if (inserted)
+				{
+					_evict();
+					_lru.push_front(id);
+					slot.lru = _lru.begin();
+				}
+				else if (slot.pins == 0)
+					_lru.splice(_lru.begin(), _lru, slot.lru);
+			}
+			return {slot, inserted};
 		}
 
-		std::optional<T> &_fetch(dpp::snowflake id)
+		// the slot of a row, read from the database on first use in lazy mode
+		// the lock is released while the row is read, another thread may have loaded it by then
+		CachedRow& _fetch(const key_type& id, std::unique_lock<std::mutex>& lock)
 		{
-			return (_data[id]);
+			while (_config.lazy && _database && !_data.contains(id))
+			{
+				uint64 evictions = _startLoading(id);
+
+				lock.unlock();
+				std::optional<T> row = _pendingRow(id);
+				if (!row.has_value())
+					_loadRow(id, row);
+				lock.lock();
+				// loaded and evicted in the meantime, it may have been edited since it was read
+				if (!_stopLoading(id, evictions))
+					continue;
+
+				auto [slot, inserted] = _slot(id);
+
+				if (inserted)
+				{
+					slot.row = std::move(row);
+					if (slot.row.has_value())
+						_indexRow(id, *slot.row);
+				}
+				return (slot);
+			}
+			return (_slot(id).first);
+		}
+
+		// a row is about to be read with _data_mutex released, returns its eviction count to compare once it is read
+		uint64 _startLoading(const key_type& id)
+		{
+			LoadingRow& loading = _loading[id];
+
+			++loading.loaders;
+			return (loading.evictions);
+		}
+
+		// false if the row was evicted while it was read
+		bool _stopLoading(const key_type& id, uint64 evictions)
+		{
+			auto it    = _loading.find(id);
+			bool fresh = it->second.evictions == evictions;
+
+			if (--it->second.loaders == 0)
+				_loading.erase(it);
+			return (fresh);
+		}
+
+		bool _loadAllFrom(DatabaseReader& reader, std::string_view query)
+		{
+			CachedStatement stmt = reader.statement(query);
+
+			if (!stmt.hasResource())
+				return (false);
+
+			std::unique_lock lock{_data_mutex};
+			auto             rows = stmt->rows();
+
+			for (const DatabaseRow& row : rows)
+			{
+				key_type          id    = _readKey(row);
+				std::optional<T>& entry = _slot(id).first.row;
+
+				entry.emplace();
+				_loadFields(row, *entry, std::make_index_sequence<T::key_list::size>());
+				_indexRow(id, *entry);
+			}
+			return (rows.done());
+		}
+
+		// reads through a reader connection, writes not committed yet are still in _pending and are looked up there first
+		void _loadRow(const key_type& id, std::optional<T>& entry)
+		{
+			constexpr auto query = _generateSelectOneQuery();
+
+			_copyMigrating(id);
+
+			DatabaseReader  reader = _database->reader();
+			CachedStatement stmt   = reader.statement(query);
+
+			if (!stmt.hasResource() || !_bindKey(*stmt, id, std::make_index_sequence<key_count>()))
+				return;
+
+			auto rows = stmt->rows();
+
+			for (const DatabaseRow& row : rows)
+			{
+				entry.emplace();
+				_loadFields(row, *entry, std::make_index_sequence<T::key_list::size>());
+			}
+			if (!rows.done())
+				B12::log(LogLevel::ERROR, "{}: could not read a row", Name.data);
+		}
+
+		// while the table is rebuilt, the row is moved from the old table before it is read
+		bool _copyMigrating(const key_type& id)
+		{
+			static constexpr auto where = GeneralQueryHelper::_getWhereClause(std::make_index_sequence<key_count>());
+
+			return (_database->copyMigrating(Name, where, [&id](DatabaseStatement& stmt) {
+				return (_bindKey(stmt, id, std::make_index_sequence<key_count>()));
+			}));
+		}
+
+		void _indexRow(const key_type& id, const T& row)
+		{
+			std::apply([&](auto&... index) { (index.set(id, row), ...); }, _indexes);
+		}
+
+		void _unindexRow(const key_type& id)
+		{
+			std::apply([&](auto&... index) { (index.erase(id), ...); }, _indexes);
+		}
+
+		// drops the least recently used rows until the cache fits its bound
+		void _evict()
+		{
+			while (_data.size() > _config.max_rows && !_lru.empty())
+			{
+				if (auto it = _loading.find(_lru.back()); it != _loading.end())
+					++it->second.evictions;
+				_unindexRow(_lru.back());
+				_data.erase(_lru.back());
+				_lru.pop_back();
+			}
+		}
+
+		void _pin(CachedRow& slot)
+		{
+			if (_isEvictable() && slot.pins++ == 0)
+				_lru.erase(slot.lru);
+		}
+
+		void _unpin(const key_type& id)
+		{
+			if (!_isEvictable())
+				return;
+
+			std::unique_lock lock{_data_mutex};
+			auto             it = _data.find(id);
+
+			if (it == _data.end() || --it->second.pins != 0)
+				return;
+			_lru.push_front(id);
+			it->second.lru = _lru.begin();
+			_evict();
 		}
 
 		template <size_t N, bool condition = true>
@@ -473,34 +1444,41 @@ namespace B12
 				return (shion::literal_concat(",", line));
 		}
 
-		template <size_t... N>
 		static consteval auto _getConstraintsLine()
 		{
-			constexpr int num_keys =
-			(0 + ... +
-				(T::field_type_list::template at<N>::FIELD_ATTRIBUTES & FieldAttributeFlags::PRIMARY_KEY
-					 ? 1
-					 : 0));
+			return (shion::literal_concat(
+				",\n\tPRIMARY KEY (",
+				GeneralQueryHelper::_getKeyList(std::make_index_sequence<key_count>()),
+				")"));
+		}
 
-			if constexpr (num_keys == 0)
-				return (""_sl);
-			else
-			{
-				return (shion::literal_concat(
-					",\n\tPRIMARY KEY (",
-					(shion::literal_concat(_getFieldName<
-						N,
-						T::field_type_list::template at<N>::FIELD_ATTRIBUTES &
-						FieldAttributeFlags::PRIMARY_KEY>()...)),
-					")"));
-			}
+		template <size_t N>
+		static consteval auto _getColumn() -> ColumnSchema
+		{
+			using helper = _::data_store_field_helper_s<typename T::field_type_list::template at<N>>;
+
+			constexpr int attributes = T::field_type_list::template at<N>::FIELD_ATTRIBUTES;
+
+			return {
+				T::key_list::template at<N>,
+				helper::storage,
+				((key_fields >> N) & 1) != 0,
+				(attributes & FieldAttributeFlags::NOT_NULL) != 0,
+				(attributes & FieldAttributeFlags::UNIQUE) != 0
+			};
+		}
+
+		template <size_t... N>
+		static consteval auto _getColumns(std::index_sequence<N...>) -> std::array<ColumnSchema, sizeof...(N)>
+		{
+			return {_getColumn<N>()...};
 		}
 
 		template <size_t... N>
 		static consteval auto _getCreateTableQuery(std::index_sequence<N...>)
 		{
 			return (
-				shion::literal_concat(_getCreateTableQuery<N>()..., _getConstraintsLine<N...>(), "\n"));
+				shion::literal_concat(_getCreateTableQuery<N>()..., _getConstraintsLine(), "\n"));
 		}
 
 		consteval static auto _generateCreateTableQuery()
@@ -515,23 +1493,70 @@ namespace B12
 				");"));
 		}
 
+		template <size_t I>
+		constexpr static auto _key_name = T::key_list::template at<_::data_store_key_field<T>(I)>;
+
+		template <size_t I>
+		using _key_part_type = typename T::value_type_list::template at<_::data_store_key_field<T>(I)>;
+
+		template <size_t I>
+		static auto _keyPart(const key_type& key) -> const _key_part_type<I>&
+		{
+			if constexpr (key_count == 1)
+				return (key);
+			else
+				return (std::get<I>(key));
+		}
+
+		template <size_t... I>
+		static key_type _keyOf(const T& row, std::index_sequence<I...>)
+		{
+			return {row.template get<_key_name<I>>()...};
+		}
+
+		static key_type _keyOf(const T& row)
+		{
+			return (_keyOf(row, std::make_index_sequence<key_count>()));
+		}
+
+		template <size_t... I>
+		static void _setKey(T& row, const key_type& key, std::index_sequence<I...>)
+		{
+			((row.template get<_key_name<I>>() = _keyPart<I>(key)), ...);
+		}
+
+		template <size_t... I>
+		static bool _bindKey(DatabaseStatement& stmt, const key_type& key, std::index_sequence<I...>)
+		{
+			return ((stmt.bind(_keyPart<I>(key)) && ...));
+		}
+
+		// the key columns of a row from a SELECT of all fields
+		template <size_t... I>
+		static key_type _readKey(const DatabaseRow& row, std::index_sequence<I...>)
+		{
+			return {row.get<_key_part_type<I>>(static_cast<int>(_::data_store_key_field<T>(I)))...};
+		}
+
+		static key_type _readKey(const DatabaseRow& row)
+		{
+			return (_readKey(row, std::make_index_sequence<key_count>()));
+		}
+
 		template <size_t N>
-		static void _loadField(DatabaseStatement& stmt, T& entry)
+		static void _loadField(const DatabaseRow& row, T& entry)
 		{
 			constexpr auto key = T::key_list::template at<N>;
 			using type = typename T::value_type_list::template at<N>;
 
-			if constexpr (std::integral<type> || std::same_as<type, dpp::snowflake>)
-			{
-				entry.template get<key>() = static_cast<type>(stmt.fetchInt64(N));
-			}
-			else if constexpr (std::floating_point<type>)
+			if constexpr (std::integral<type> || std::floating_point<type> || std::same_as<type, dpp::snowflake>)
 			{
-				entry.template get<key>() = static_cast<type>(stmt.fetchDouble(N));
+				entry.template get<key>() = row.get<type>(N);
 			}
-			else if constexpr (std::assignable_from<type, std::string>)
+			else if constexpr (std::assignable_from<type&, std::string_view>)
 			{
-				entry.template get<key>() = static_cast<type>(stmt.fetchText(N));
+				// assigned from the view, the field reuses its own storage
+				entry.template get<key>() = row.text(N);
 			}
 			else
 			{
@@ -540,46 +1565,81 @@ namespace B12
 		}
 
 		template <size_t... Ns>
-		static void _loadFields(DatabaseStatement& stmt, T& entry, std::index_sequence<Ns...>)
+		static void _loadFields(const DatabaseRow& row, T& entry, std::index_sequence<Ns...>)
 		{
-			(_loadField<Ns>(stmt, entry), ...);
+			(_loadField<Ns>(row, entry), ...);
 		}
 
-		shion::utils::observer_ptr<Database>                 _database{nullptr};
-		std::unordered_map<dpp::snowflake, std::optional<T>> _data;
-
-		std::function<bool(DatabaseStatement&)> _loadCallback = [this](DatabaseStatement& s)
-		{
-			dpp::snowflake    id{static_cast<uint64>(s.fetchInt64(0))};
-			std::optional<T>& entry = _data[id];
-
-			entry = GuildSettingsEntry{};
-			_loadFields(s, entry.value(), std::make_index_sequence<T::key_list::size>());
-			return (true);
-		};
+		shion::utils::observer_ptr<Database>                               _database{nullptr};
+		DataStoreConfig                                                    _config;
+		std::unordered_map<key_type, CachedRow, _::data_store_key_hash>    _data;
+		std::list<key_type>                                                _lru; // unpinned rows, most recently used first
+		std::unordered_map<key_type, LoadingRow, _::data_store_key_hash>   _loading;
+		typename SecondaryIndexes<indexes>::type                           _indexes;
+		std::mutex                                                         _data_mutex;
+		std::unordered_map<key_type, PendingWrite, _::data_store_key_hash> _pending;
+		std::mutex                                                         _pending_mutex;
+		uint64                                                             _commits{0}; // rows taken out of _pending once committed
+		std::vector<std::jthread>                                          _warm_ups;
+		std::mutex                                                         _warm_up_mutex;
 	};
 
 	template <typename T, shion::string_literal Name>
 	bool DataStore<T, Name>::save(const Entry& entry)
 	{
+		// the edits may have moved the row in the indexes
+		_reindex(entry._entry);
 		if (!_database)
 			return (false);
+		if (_database->isWriteBehind())
+			return (_queueWrite(entry));
+		// entries that only read, such as the short-lived ones, do not wait on the writes of other threads
+		if (!entry.editedMask())
+			return (true);
 
-		DatabaseStatement statement;
+		CachedStatement statement;
+		auto            lock = _database->lockWrites();
 
-		if (entry._is_new)
-		{
-			if (!entry.fillInsertStatement(statement))
-				return (false);
-		}
-		else
-		{
-			if (!entry.fillUpdateStatement(statement))
-				return (false);
-		}
+		if (!entry.fillUpsertStatement(statement))
+			return (false);
 		if (!statement.hasResource())
 			return (true);
-		return (statement.exec());
+		if (!statement->exec())
+			return (false);
+		entry.markClean();
+		return (true);
+	}
+
+	template <typename T, shion::string_literal Name>
+	auto DataStore<T, Name>::saveAsync(const Entry& entry) -> DatabaseTask<bool>
+	{
+		_reindex(entry._entry);
+		if (!_database)
+			return (DatabaseTask<bool>::done(false));
+		if (_database->isWriteBehind())
+			return (DatabaseTask<bool>::done(_queueWrite(entry)));
+
+		field_mask edited = entry.editedMask();
+
+		if (!edited)
+			return (DatabaseTask<bool>::done(true));
+
+		key_type id       = _keyOf(entry._entry);
+		auto     follower = std::make_shared<_::database_task_state<bool>>(_database->resumer());
+
+		// the row is already queued, its job writes the new values and completes the task
+		if (!_stageWrite(entry, id, edited, follower))
+			return (DatabaseTask<bool>{std::move(follower)});
+		// the copy is taken under the write lock, a later save of the row cannot be overwritten by an earlier one
+		return (_database->async([this, id]()
+		{
+			auto lock    = _database->lockWrites();
+			bool success = _writePending(id);
+
+			// outside of a transaction, the write is committed once it ran
+			_commitPending(id);
+			return (success);
+		}));
 	}
 }
 
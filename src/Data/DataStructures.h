@@ -3,6 +3,8 @@
 
 #include "B12.h"
 
+#include <tuple>
+
 namespace B12
 {
 	namespace _
@@ -14,7 +16,8 @@ namespace B12
 				NONE        = shion::bitflag(0),
 				PRIMARY_KEY = shion::bitflag(1),
 				UNIQUE      = shion::bitflag(2),
-				NOT_NULL    = shion::bitflag(3)
+				NOT_NULL    = shion::bitflag(3),
+				INDEXED     = shion::bitflag(4)  // gets an index in the table, and a reverse lookup in the data store
 			};
 		};
 	}
@@ -52,8 +55,8 @@ namespace B12
 			return (std::move(value));
 		}
 
-		ValueType& value;
-		bool       edited{false};
+		ValueType&   value;
+		mutable bool edited{false}; // cleared by the data store once the value is saved
 	};
 
 	template <auto Key, typename ValueType, FieldAttributeFlags Attributes>
@@ -104,11 +107,26 @@ namespace B12
 		return DataField<Key, T, Attributes>(std::forward<Args>(args)...);
 	}
 
+	// an index over several fields, in this order
+	template <shion::string_literal... Fields>
+	struct DataIndex
+	{
+		static_assert(sizeof...(Fields) > 0, "an index needs at least one field");
+	};
+
+	// indexes over several fields of a registry, declared by specializing this with a tuple of DataIndex
+	// INDEXED fields get their own, they do not need to be declared here
+	template <typename Registry>
+	struct data_indexes
+	{
+		using type = std::tuple<>;
+	};
+
 	using GuildSettingsEntry = decltype(shion::registry(
 		data_field<"snowflake", dpp::snowflake, FieldAttributeFlags::PRIMARY_KEY>(),
 		data_field<"study_channel", dpp::snowflake>(),
 		data_field<"study_react_message", dpp::snowflake>(),
-		data_field<"study_role", dpp::snowflake>()
+		data_field<"study_role", dpp::snowflake, FieldAttributeFlags::INDEXED>()
 	));
 } // namespace MyNamespace
 
@@ -4,6 +4,11 @@
 
 #include "Core/Bot.h"
 
+#include <algorithm>
+#include <cctype>
+
+#include <fmt/chrono.h>
+
 extern "C"
 {
 	#include <sqlite3.h>
@@ -11,11 +16,70 @@ extern "C"
 
 using namespace B12;
 
-bool Database::open(std::filesystem::path path)
+namespace
+{
+	// the keyword in upper case if it is one of the accepted ones, empty otherwise
+	auto pragma_keyword(std::string_view value, std::initializer_list<std::string_view> accepted) -> std::string
+	{
+		std::string upper{value};
+
+		for (char& c : upper)
+			c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+		if (std::ranges::find(accepted, std::string_view{upper}) == accepted.end())
+			return {};
+		return (upper);
+	}
+
+	bool iequals(std::string_view lhs, std::string_view rhs)
+	{
+		return (std::ranges::equal(lhs, rhs, [](char a, char b) {
+			return (std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)));
+		}));
+	}
+
+	struct table_column
+	{
+		std::string name;
+		std::string type;
+		bool        primary_key;
+		bool        not_null{false};
+		bool        unique{false};
+	};
+
+	// pause between two chunks of a migration, the writer and lookups get the connection in between
+	constexpr auto MIGRATION_PAUSE = std::chrono::milliseconds{5};
+
+	// the profile shared by statements past ProfilerConfig::max_statements
+	constexpr auto OTHER_STATEMENTS = std::string_view{"(other statements)"};
+
+	// one bucket per power of 10, from 10us
+	auto profile_bucket(std::chrono::nanoseconds duration) -> size_t
+	{
+		size_t bucket = 0;
+
+		for (int64 bound = 10'000; bucket + 1 < QueryProfile::BUCKETS && duration.count() >= bound; bound *= 10)
+			++bucket;
+		return (bucket);
+	}
+}
+
+Database::~Database()
+{
+	_stopExecutors();
+	_stopMigrations();
+	_stopBackups();
+	_stopWriter();
+	_idle_readers.clear();
+	_readers.clear();
+	_main.statements.clear();
+}
+
+bool Database::open(std::filesystem::path path, const DatabaseTuning& tuning)
 {
 	sqlite3* ptr;
 
 	_name = stdfs::relative(path).string();
+	_path = path;
 	if (int ret = sqlite3_open_v2(
 			path.string().c_str(),
 			&ptr,
@@ -40,17 +104,122 @@ bool Database::open(std::filesystem::path path)
 		}
 		_name = fmt::format("(virtual) {}", _name);
 		B12::log(B12::LogLevel::ERROR, "  opened database as in-memory instead");
+		_main.handle = ptr;
+		_applyTuning(tuning);
+		_startExecutors(tuning.executors);
+		return (true);
 	}
-	_database = ptr;
+	_main.handle = ptr;
+	_applyTuning(tuning);
+	_openReaders(path, tuning);
+	_startExecutors(tuning.executors);
 	return (true);
 }
 
+void Database::_openReaders(const std::filesystem::path& path, const DatabaseTuning& tuning)
+{
+	// each reader is used by a single thread at a time, sqlite does not need to lock it
+	for (size_t i = 0; i < tuning.readers; ++i)
+	{
+		sqlite3* ptr;
+
+		if (int ret = sqlite3_open_v2(
+				path.string().c_str(),
+				&ptr,
+				SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+				nullptr
+			);
+			ret != SQLITE_OK)
+		{
+			B12::log(B12::LogLevel::ERROR, "{} : could not open reader connection: {}", _name, sqlite3_errstr(ret));
+			sqlite3_close(ptr);
+			break;
+		}
+
+		auto connection = std::make_unique<_::database_connection>();
+
+		connection->handle = ptr;
+		_applyReaderTuning(ptr, tuning);
+		_idle_readers.push_back(connection.get());
+		_readers.push_back(std::move(connection));
+	}
+	B12::log(B12::LogLevel::BASIC, "{}: {} reader connections", _name, _readers.size());
+}
+
+void Database::_applyTuning(const DatabaseTuning& tuning)
+{
+	auto set_keyword = [this](std::string_view pragma, std::string_view value, std::initializer_list<std::string_view> accepted)
+	{
+		if (value.empty())
+			return;
+		if (std::string keyword = pragma_keyword(value, accepted); !keyword.empty())
+			exec(fmt::format("PRAGMA {} = {}", pragma, keyword));
+		else
+			B12::log(B12::LogLevel::ERROR, "{}: invalid value \"{}\" for {}, keeping the default", _name, value, pragma);
+	};
+
+	set_keyword("journal_mode", tuning.journal_mode, {"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"});
+	set_keyword("synchronous", tuning.synchronous, {"OFF", "NORMAL", "FULL", "EXTRA"});
+	set_keyword("temp_store", tuning.temp_store, {"DEFAULT", "FILE", "MEMORY"});
+	exec(fmt::format("PRAGMA mmap_size = {}", tuning.mmap_size));
+	exec(fmt::format("PRAGMA cache_size = {}", tuning.cache_size));
+	sqlite3_busy_timeout(_main.handle.get(), static_cast<int>(tuning.busy_timeout.count()));
+
+	// sqlite may not apply what was asked, for example WAL on an in-memory database, or mmap beyond its compile-time limit
+	B12::log(
+		B12::LogLevel::BASIC,
+		"{}: journal_mode={} synchronous={} temp_store={} mmap_size={} cache_size={} busy_timeout={}ms",
+		_name,
+		_pragma("journal_mode"),
+		_pragma("synchronous"),
+		_pragma("temp_store"),
+		_pragma("mmap_size"),
+		_pragma("cache_size"),
+		_pragma("busy_timeout")
+	);
+}
+
+// journal_mode and synchronous belong to the database file and the writer, readers only take what speeds up reads
+void Database::_applyReaderTuning(sqlite3* connection, const DatabaseTuning& tuning)
+{
+	if (std::string keyword = pragma_keyword(tuning.temp_store, {"DEFAULT", "FILE", "MEMORY"}); !keyword.empty())
+		_exec(connection, fmt::format("PRAGMA temp_store = {}", keyword));
+	_exec(connection, fmt::format("PRAGMA mmap_size = {}", tuning.mmap_size));
+	_exec(connection, fmt::format("PRAGMA cache_size = {}", tuning.cache_size));
+	sqlite3_busy_timeout(connection, static_cast<int>(tuning.busy_timeout.count()));
+}
+
+auto Database::_pragma(std::string_view name) -> std::string
+{
+	std::string       value;
+	DatabaseStatement stmt = prepare(fmt::format("PRAGMA {}", name));
+
+	if (stmt.hasResource())
+	{
+		stmt.exec(
+			[&value](DatabaseStatement& row)
+			{
+				value = row.fetchText(0);
+				return (true);
+			}
+		);
+	}
+	return (value);
+}
+
 bool Database::exec(const std::string& query)
+{
+	std::unique_lock lock{_transaction_mutex};
+
+	return (_exec(_main.handle.get(), query));
+}
+
+bool Database::_exec(sqlite3* connection, const std::string& query)
 {
 	char* error{nullptr};
 
 	B12::log(B12::LogLevel::TRACE, "Executing SQL query (exec):\n{}\n", query);
-	if (int ret = sqlite3_exec(_database.get(), query.c_str(), nullptr, nullptr, &error);
+	if (int ret = sqlite3_exec(connection, query.c_str(), nullptr, nullptr, &error);
 		error || ret != SQLITE_OK)
 	{
 		B12::log(
@@ -71,10 +240,11 @@ bool Database::exec(const std::string& query)
 
 bool Database::_query(const std::string& query, sqlite_callback callback, void* userdata)
 {
-	char* error{nullptr};
+	std::unique_lock lock{_transaction_mutex};
+	char*            error{nullptr};
 
 	B12::log(B12::LogLevel::TRACE, "Executing SQL query (query):\n{}\n", query);
-	if (int ret = sqlite3_exec(_database.get(), query.c_str(), callback, userdata, &error);
+	if (int ret = sqlite3_exec(_main.handle.get(), query.c_str(), callback, userdata, &error);
 		error || ret != SQLITE_OK)
 	{
 		B12::log(
@@ -94,19 +264,24 @@ bool Database::_query(const std::string& query, sqlite_callback callback, void*
 }
 
 DatabaseStatement Database::prepare(std::string_view query)
+{
+	return (_prepare(_main.handle.get(), query));
+}
+
+DatabaseStatement Database::_prepare(sqlite3* connection, std::string_view query)
 {
 	sqlite3_stmt* ret;
 	const char*   tail;
 
 	if (int err = sqlite3_prepare_v3(
-			_database.get(),
+			connection,
 			query.data(),
 			static_cast<int>(query.size()),
 			SQLITE_PREPARE_NO_VTAB,
 			&ret,
 			&tail
 		);
-		err < 0)
+		err != SQLITE_OK)
 	{
 		B12::log(
 			B12::LogLevel::ERROR,
@@ -121,3 +296,1076 @@ DatabaseStatement Database::prepare(std::string_view query)
 	}
 	return {ret};
 }
+
+CachedStatement Database::statement(std::string_view query)
+{
+	return (_statement(_main, &_statements_mutex, query));
+}
+
+CachedStatement Database::_statement(_::database_connection& connection, std::mutex* mutex, std::string_view query)
+{
+	std::unique_lock<std::mutex> lock;
+
+	if (mutex)
+		lock = std::unique_lock{*mutex};
+
+	auto it = connection.statements.find(query);
+
+	if (it == connection.statements.end())
+		it = connection.statements.try_emplace(std::string{query}).first;
+
+	CachedStatement::pool* statements = &it->second;
+
+	if (!statements->empty())
+	{
+		DatabaseStatement stmt = std::move(statements->back());
+
+		statements->pop_back();
+		return {statements, mutex, std::move(stmt)};
+	}
+	if (lock.owns_lock())
+		lock.unlock();
+
+	DatabaseStatement stmt = _prepare(connection.handle.get(), query);
+
+	if (!stmt.hasResource())
+		return {};
+	return {statements, mutex, std::move(stmt)};
+}
+
+DatabaseReader Database::reader()
+{
+	std::unique_lock lock{_readers_mutex};
+
+	if (_readers.empty())
+		return {this, nullptr};
+	_readers_cv.wait(lock, [this]() { return (!_idle_readers.empty()); });
+
+	_::database_connection* connection = _idle_readers.back();
+
+	_idle_readers.pop_back();
+	_traceConnection(*connection);
+	return {this, connection};
+}
+
+void Database::_returnReader(_::database_connection* connection)
+{
+	{
+		std::unique_lock lock{_readers_mutex};
+
+		_idle_readers.push_back(connection);
+	}
+	_readers_cv.notify_one();
+}
+
+DatabaseReader::DatabaseReader(Database* database, _::database_connection* connection) :
+	_database{database},
+	_connection{connection}
+{
+}
+
+DatabaseReader::DatabaseReader(DatabaseReader&& rhs) noexcept :
+	_database{std::exchange(rhs._database, nullptr)},
+	_connection{std::exchange(rhs._connection, nullptr)}
+{
+}
+
+DatabaseReader::~DatabaseReader()
+{
+	if (_database && _connection)
+		_database->_returnReader(_connection);
+}
+
+CachedStatement DatabaseReader::statement(std::string_view query)
+{
+	if (!_database)
+		return {};
+	if (!_connection)
+		return (_database->statement(query));
+	return (_database->_statement(*_connection, nullptr, query));
+}
+
+CachedStatement::CachedStatement(pool* statements, std::mutex* mutex, DatabaseStatement statement) :
+	_pool{statements},
+	_mutex{mutex},
+	_statement{std::move(statement)}
+{
+}
+
+CachedStatement::CachedStatement(CachedStatement&& rhs) noexcept :
+	_pool{std::exchange(rhs._pool, nullptr)},
+	_mutex{std::exchange(rhs._mutex, nullptr)},
+	_statement{std::move(rhs._statement)}
+{
+}
+
+CachedStatement::~CachedStatement()
+{
+	_recycle();
+}
+
+CachedStatement &CachedStatement::operator=(CachedStatement&& rhs) noexcept
+{
+	_recycle();
+	_pool      = std::exchange(rhs._pool, nullptr);
+	_mutex     = std::exchange(rhs._mutex, nullptr);
+	_statement = std::move(rhs._statement);
+	return (*this);
+}
+
+void CachedStatement::_recycle()
+{
+	if (_pool && _statement.hasResource())
+	{
+		_statement.reset();
+		if (_mutex)
+		{
+			std::unique_lock lock{*_mutex};
+
+			_pool->push_back(std::move(_statement));
+		}
+		else
+			_pool->push_back(std::move(_statement));
+	}
+	_pool  = nullptr;
+	_mutex = nullptr;
+}
+
+void Database::_startExecutors(size_t count)
+{
+	std::unique_lock lock{_jobs_mutex};
+
+	if (!_executors.empty() || count == 0)
+		return;
+	_async = true;
+	for (size_t i = 0; i < count; ++i)
+		_executors.emplace_back([this](std::stop_token stop) { _runExecutor(stop); });
+}
+
+void Database::_stopExecutors()
+{
+	std::vector<std::jthread> executors;
+
+	{
+		std::unique_lock lock{_jobs_mutex};
+
+		// jobs from now on run right away, the executors still run what was queued before they exit
+		_async = false;
+		executors.swap(_executors);
+	}
+	for (std::jthread& executor : executors)
+		executor.request_stop();
+	for (std::jthread& executor : executors)
+		executor.join();
+}
+
+void Database::_runExecutor(std::stop_token stop)
+{
+	std::unique_lock lock{_jobs_mutex};
+
+	while (true)
+	{
+		_jobs_cv.wait(lock, stop, [this]() { return (!_jobs.empty()); });
+		if (_jobs.empty())
+			break;
+
+		std::function<void()> job = std::move(_jobs.front());
+
+		_jobs.pop_front();
+		lock.unlock();
+		job();
+		lock.lock();
+	}
+}
+
+void Database::_post(std::function<void()> job)
+{
+	{
+		std::unique_lock lock{_jobs_mutex};
+
+		if (_async)
+		{
+			_jobs.push_back(std::move(job));
+			_jobs_cv.notify_one();
+			return;
+		}
+	}
+	job();
+}
+
+void Database::setResumer(database_resumer resumer)
+{
+	std::unique_lock lock{_jobs_mutex};
+
+	_resumer = std::move(resumer);
+}
+
+auto Database::resumer() const -> database_resumer
+{
+	std::unique_lock lock{_jobs_mutex};
+
+	return (_resumer);
+}
+
+void Database::setWriteBehind(WriteBehindConfig config)
+{
+	_stopWriter();
+	if (!config.enabled)
+		return;
+
+	std::unique_lock lock{_write_mutex};
+
+	_write_config = config;
+	_write_behind = true;
+	_writer = std::jthread{[this](std::stop_token stop) { _runWriter(stop); }};
+}
+
+bool Database::isWriteBehind() const
+{
+	std::unique_lock lock{_write_mutex};
+
+	return (_write_behind);
+}
+
+bool Database::write(write_job job, on_commit committed)
+{
+	{
+		std::unique_lock lock{_write_mutex};
+
+		if (_write_behind)
+		{
+			_write_queue.push_back({std::move(job), std::move(committed)});
+			++_write_queued;
+			_write_cv.notify_one();
+			return (true);
+		}
+	}
+
+	std::unique_lock lock{_transaction_mutex};
+	bool             success = job();
+
+	if (committed)
+		committed();
+	return (success);
+}
+
+void Database::flush()
+{
+	std::unique_lock lock{_write_mutex};
+	uint64           target = _write_queued;
+
+	if (!_write_behind || _write_committed >= target)
+		return;
+	_flush_requested = true;
+	_write_cv.notify_one();
+	_flushed_cv.wait(lock, [this, target]() { return (_write_committed >= target); });
+}
+
+void Database::_stopWriter()
+{
+	{
+		std::unique_lock lock{_write_mutex};
+
+		// writes from now on run right away, the writer still commits what was queued before it exits
+		_write_behind = false;
+	}
+	if (_writer.joinable())
+	{
+		_writer.request_stop();
+		_writer.join();
+	}
+}
+
+void Database::_runWriter(std::stop_token stop)
+{
+	std::vector<queued_write> batch;
+	std::unique_lock          lock{_write_mutex};
+
+	while (true)
+	{
+		_write_cv.wait(lock, stop, [this]() { return (!_write_queue.empty() || _flush_requested); });
+		if (_write_queue.empty() && !_flush_requested && stop.stop_requested())
+			break;
+
+		// let the batch fill up, unless someone is waiting on it
+		_write_cv.wait_for(lock, stop, _write_config.max_delay, [this]() {
+			return (_write_queue.size() >= _write_config.max_batch || _flush_requested);
+		});
+
+		uint64 target = _write_queued;
+
+		batch.swap(_write_queue);
+		_flush_requested = false;
+		lock.unlock();
+		_commitBatch(batch);
+		batch.clear();
+		lock.lock();
+		_write_committed = target;
+		_flushed_cv.notify_all();
+	}
+}
+
+void Database::_commitBatch(std::vector<queued_write>& batch)
+{
+	if (batch.empty())
+		return;
+
+	// one transaction for the whole batch, a failed write only loses its own statement
+	std::unique_lock lock{_transaction_mutex};
+	bool             transaction = exec("BEGIN");
+	size_t           failed      = 0;
+
+	for (queued_write& write : batch)
+	{
+		if (!write.job())
+			++failed;
+	}
+	if (failed)
+		B12::log(B12::LogLevel::ERROR, "{}: {} of {} queued writes failed", _name, failed, batch.size());
+	if (transaction && !exec("COMMIT"))
+	{
+		B12::log(B12::LogLevel::ERROR, "{}: could not commit a batch of {} writes, rolling it back", _name, batch.size());
+		exec("ROLLBACK");
+	}
+	for (queued_write& write : batch)
+	{
+		if (write.committed)
+			write.committed();
+	}
+}
+
+bool Database::backup(const std::filesystem::path& destination, std::stop_token stop)
+{
+	std::error_code err;
+	sqlite3*        ptr;
+
+	if (auto parent_path = destination.parent_path(); !parent_path.empty() && !stdfs::create_directories(parent_path, err) && err)
+	{
+		B12::log(B12::LogLevel::ERROR, "{}: could not create backup directory {}: {}", _name, parent_path.string(), err.message());
+		return (false);
+	}
+	if (int ret = sqlite3_open_v2(destination.string().c_str(), &ptr, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr); ret != SQLITE_OK)
+	{
+		B12::log(B12::LogLevel::ERROR, "{}: could not open backup {}: {}", _name, destination.string(), sqlite3_errstr(ret));
+		sqlite3_close(ptr);
+		return (false);
+	}
+
+	shion::utils::owned_resource<sqlite3*, _::close_database> target{std::move(ptr)};
+	shion::utils::owned_resource<sqlite3*, _::close_database> snapshot{_openSnapshot()};
+
+	// without a snapshot connection, writes through the main connection are carried into the copy as it goes
+	sqlite3*        source = (snapshot.get() ? snapshot.get() : _main.handle.get());
+	sqlite3_backup* backup = sqlite3_backup_init(target.get(), "main", source, "main");
+
+	if (!backup)
+	{
+		B12::log(B12::LogLevel::ERROR, "{}: could not start backup to {}: {}", _name, destination.string(), sqlite3_errmsg(target.get()));
+		return (false);
+	}
+
+	int ret;
+
+	do
+	{
+		ret = sqlite3_backup_step(backup, _backup_config.pages_per_step);
+		if (ret == SQLITE_OK || ret == SQLITE_BUSY || ret == SQLITE_LOCKED)
+			std::this_thread::sleep_for(_backup_config.step_delay);
+	} while ((ret == SQLITE_OK || ret == SQLITE_BUSY || ret == SQLITE_LOCKED) && !stop.stop_requested());
+
+	int remaining = sqlite3_backup_remaining(backup);
+	int pages     = sqlite3_backup_pagecount(backup);
+
+	sqlite3_backup_finish(backup);
+	if (ret != SQLITE_DONE)
+	{
+		B12::log(
+			B12::LogLevel::ERROR,
+			"{}: backup to {} stopped with {} of {} pages left: {}",
+			_name,
+			destination.string(),
+			remaining,
+			pages,
+			(ret == SQLITE_OK ? "interrupted" : sqlite3_errstr(ret))
+		);
+		return (false);
+	}
+	B12::log(B12::LogLevel::BASIC, "{}: backed up {} pages to {}", _name, pages, destination.string());
+	return (true);
+}
+
+// in WAL mode, a connection holding a read transaction sees the same state for the whole copy, and does not hold up the writer
+// returns null otherwise
+auto Database::_openSnapshot() -> sqlite3*
+{
+	sqlite3* ptr;
+
+	if (_pragma("journal_mode") != "wal")
+		return (nullptr);
+	if (int ret = sqlite3_open_v2(_path.string().c_str(), &ptr, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr); ret != SQLITE_OK)
+	{
+		B12::log(B12::LogLevel::ERROR, "{}: could not open snapshot connection: {}", _name, sqlite3_errstr(ret));
+		sqlite3_close(ptr);
+		return (nullptr);
+	}
+	// the read transaction only starts with the first read
+	if (!_exec(ptr, "BEGIN") || !_exec(ptr, "SELECT COUNT(*) FROM sqlite_schema"))
+	{
+		sqlite3_close(ptr);
+		return (nullptr);
+	}
+	return (ptr);
+}
+
+void Database::setBackup(BackupConfig config)
+{
+	_stopBackups();
+	if (!config.enabled)
+		return;
+
+	std::unique_lock lock{_backup_mutex};
+
+	_backup_config    = std::move(config);
+	_backup_requested = false;
+	_backup_thread    = std::jthread{[this](std::stop_token stop) { _runBackups(stop); }};
+}
+
+bool Database::requestBackup()
+{
+	std::unique_lock lock{_backup_mutex};
+
+	if (!_backup_thread.joinable())
+		return (false);
+	_backup_requested = true;
+	_backup_cv.notify_one();
+	return (true);
+}
+
+void Database::_stopBackups()
+{
+	if (_backup_thread.joinable())
+	{
+		_backup_thread.request_stop();
+		_backup_thread.join();
+	}
+}
+
+void Database::_runBackups(std::stop_token stop)
+{
+	std::unique_lock lock{_backup_mutex};
+	auto             requested = [this]() { return (_backup_requested); };
+
+	while (!stop.stop_requested())
+	{
+		if (_backup_config.interval.count() > 0)
+			_backup_cv.wait_for(lock, stop, _backup_config.interval, requested);
+		else
+			_backup_cv.wait(lock, stop, requested);
+		if (stop.stop_requested())
+			break;
+		_backup_requested = false;
+		lock.unlock();
+		_snapshot(stop);
+		lock.lock();
+	}
+}
+
+bool Database::_snapshot(std::stop_token stop)
+{
+	auto            now  = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+	std::string     name = fmt::format("{}-{:%Y%m%d-%H%M%S}.sqlite", _path.stem().string(), now);
+	stdfs::path     path = _backup_config.directory / name;
+	stdfs::path     part = _backup_config.directory / (name + ".part");
+	std::error_code err;
+
+	// a snapshot gets its name once complete, an interrupted one leaves a .part file for the next rotation
+	if (!backup(part, stop))
+	{
+		stdfs::remove(part, err);
+		return (false);
+	}
+	if (stdfs::rename(part, path, err); err)
+	{
+		B12::log(B12::LogLevel::ERROR, "{}: could not rename backup {}: {}", _name, part.string(), err.message());
+		return (false);
+	}
+	_rotateBackups();
+	return (true);
+}
+
+void Database::_rotateBackups()
+{
+	std::string              prefix = _path.stem().string() + "-";
+	std::vector<stdfs::path> snapshots;
+	std::error_code          err;
+
+	for (const stdfs::directory_entry& entry : stdfs::directory_iterator{_backup_config.directory, err})
+	{
+		std::string name = entry.path().filename().string();
+
+		if (!entry.is_regular_file() || !name.starts_with(prefix))
+			continue;
+		if (name.ends_with(".sqlite"))
+			snapshots.push_back(entry.path());
+		else if (name.ends_with(".sqlite.part"))
+			stdfs::remove(entry.path(), err);
+	}
+	if (snapshots.size() <= _backup_config.keep)
+		return;
+
+	// timestamps in the names sort oldest first
+	std::ranges::sort(snapshots);
+	for (const stdfs::path& old : std::span{snapshots}.first(snapshots.size() - _backup_config.keep))
+	{
+		if (!stdfs::remove(old, err) && err)
+			B12::log(B12::LogLevel::ERROR, "{}: could not delete old backup {}: {}", _name, old.string(), err.message());
+	}
+}
+
+bool Database::migrate(const TableSchema& schema, size_t chunk_rows)
+{
+	// another store on the same table already started the rebuild
+	if (isMigrating(schema.name))
+		return (true);
+	return (_migrateTable(schema, chunk_rows) && _migrateIndexes(schema));
+}
+
+bool Database::_migrateTable(const TableSchema& schema, size_t chunk_rows)
+{
+	std::vector<table_column> existing;
+	CachedStatement           info = statement(fmt::format("PRAGMA table_info({})", schema.name));
+
+	if (!info.hasResource())
+		return (false);
+	info->exec([&existing](DatabaseStatement& row)
+	{
+		existing.push_back({std::string{row.fetchText(1)}, std::string{row.fetchText(2)}, row.fetchInt64(5) != 0, row.fetchInt64(3) != 0});
+		return (true);
+	});
+	for (const std::string& name : _uniqueColumns(schema.name))
+	{
+		if (auto it = std::ranges::find_if(existing, [&name](const table_column& c) { return (iequals(c.name, name)); }); it != existing.end())
+			it->unique = true;
+	}
+
+	// a rebuild interrupted by a restart goes on from the rows it did not move yet
+	if (_hasTable(fmt::format("{}__old", schema.name)))
+		return (exec(std::string{schema.create_query}) && _startMigration(schema, chunk_rows));
+	if (existing.empty())
+		return (exec(std::string{schema.create_query}));
+
+	std::vector<const ColumnSchema*> added;
+	bool                             rebuild = false;
+
+	for (const ColumnSchema& column : schema.columns)
+	{
+		auto it = std::ranges::find_if(existing, [&column](const table_column& c) { return (iequals(c.name, column.name)); });
+
+		// sqlite cannot add a column with these constraints, nor change the constraints of a column
+		if (it == existing.end())
+		{
+			if (column.primary_key || column.not_null || column.unique)
+				rebuild = true;
+			else
+				added.push_back(&column);
+		}
+		else if (!iequals(it->type, column.type) || it->primary_key != column.primary_key ||
+		         it->not_null != column.not_null || it->unique != column.unique)
+			rebuild = true;
+	}
+	// columns that are not in the schema anymore are left as they are, unless they were keys
+	for (const table_column& column : existing)
+	{
+		if (column.primary_key && std::ranges::none_of(schema.columns, [&column](const ColumnSchema& c) { return (iequals(c.name, column.name)); }))
+			rebuild = true;
+	}
+	if (rebuild)
+	{
+		B12::log(B12::LogLevel::BASIC, "{}: rebuilding table {} for its new schema", _name, schema.name);
+		// indexes keep their name when their table is renamed, the new table could not have them
+		std::vector<std::string> indexes = _ownIndexes(schema.name);
+
+		if (!transaction([&]()
+		{
+			for (const std::string& index : indexes)
+			{
+				if (!exec(fmt::format("DROP INDEX {}", index)))
+					return (false);
+			}
+			return (exec(fmt::format("ALTER TABLE {0} RENAME TO {0}__old", schema.name)) && exec(std::string{schema.create_query}));
+		}))
+			return (false);
+		return (_startMigration(schema, chunk_rows));
+	}
+	if (added.empty())
+		return (true);
+	return (transaction([&]()
+	{
+		for (const ColumnSchema* column : added)
+		{
+			B12::log(B12::LogLevel::BASIC, "{}: adding column {} to table {}", _name, column->name, schema.name);
+			if (!exec(fmt::format("ALTER TABLE {} ADD COLUMN {} {}", schema.name, column->name, column->type)))
+				return (false);
+		}
+		return (true);
+	}));
+}
+
+bool Database::_migrateIndexes(const TableSchema& schema)
+{
+	std::vector<std::string> existing = _ownIndexes(schema.name);
+
+	return (transaction([&]()
+	{
+		for (const std::string& index : existing)
+		{
+			if (std::ranges::any_of(schema.indexes, [&index](const IndexSchema& i) { return (iequals(i.name, index)); }))
+				continue;
+			B12::log(B12::LogLevel::BASIC, "{}: dropping index {}", _name, index);
+			if (!exec(fmt::format("DROP INDEX {}", index)))
+				return (false);
+		}
+		for (const IndexSchema& index : schema.indexes)
+		{
+			if (!exec(fmt::format("CREATE INDEX IF NOT EXISTS {} ON {} ({})", index.name, schema.name, index.columns)))
+				return (false);
+		}
+		return (true);
+	}));
+}
+
+// columns with a UNIQUE constraint of their own, sqlite keeps them as indexes
+auto Database::_uniqueColumns(std::string_view table) -> std::vector<std::string>
+{
+	std::vector<std::string> columns;
+	std::vector<std::string> indexes;
+	CachedStatement          list = statement(fmt::format("PRAGMA index_list({})", table));
+
+	if (!list.hasResource())
+		return (columns);
+	list->exec([&indexes](DatabaseStatement& row)
+	{
+		if (row.fetchInt64(2) != 0 && row.fetchText(3) == "u")
+			indexes.emplace_back(row.fetchText(1));
+		return (true);
+	});
+	for (const std::string& index : indexes)
+	{
+		std::vector<std::string> indexed;
+		CachedStatement          info = statement(fmt::format("PRAGMA index_info({})", index));
+
+		if (!info.hasResource())
+			continue;
+		info->exec([&indexed](DatabaseStatement& row)
+		{
+			indexed.emplace_back(row.fetchText(2));
+			return (true);
+		});
+		if (indexed.size() == 1)
+			columns.push_back(std::move(indexed.front()));
+	}
+	return (columns);
+}
+
+// the indexes of a table that were created for its schema, sqlite's own have no SQL
+auto Database::_ownIndexes(std::string_view table) -> std::vector<std::string>
+{
+	std::vector<std::string> indexes;
+	std::string              prefix = fmt::format("{}__", table);
+	CachedStatement          stmt   = statement("SELECT name FROM sqlite_schema WHERE type = 'index' AND tbl_name = ? AND sql IS NOT NULL");
+
+	if (!stmt.hasResource() || !stmt->bind(table))
+		return (indexes);
+	stmt->exec([&](DatabaseStatement& row)
+	{
+		if (std::string name{row.fetchText(0)}; name.starts_with(prefix))
+			indexes.push_back(std::move(name));
+		return (true);
+	});
+	return (indexes);
+}
+
+bool Database::isMigrating(std::string_view table)
+{
+	std::unique_lock lock{_migrations_mutex};
+	auto             it = _migrations.find(table);
+
+	return (it != _migrations.end() && !it->second.done);
+}
+
+bool Database::copyMigrating(std::string_view table, std::string_view where, const std::function<bool(DatabaseStatement&)>& bind)
+{
+	std::unique_lock lock{_migrations_mutex};
+	auto             it = _migrations.find(table);
+
+	if (it == _migrations.end() || it->second.done)
+		return (true);
+
+	Migration& migration = it->second;
+
+	if (!migration.keys_copied)
+	{
+		_migrated_cv.wait(lock, [&migration]() { return (migration.done); });
+		return (true);
+	}
+
+	std::string copy_query   = fmt::format("{}{}", migration.copy_query, where);
+	std::string delete_query = fmt::format("{}{}", migration.delete_query, where);
+
+	lock.unlock();
+	return (transaction([&]()
+	{
+		// the old table is dropped in a transaction too, once the rebuild is done
+		if (std::unique_lock migrations_lock{_migrations_mutex}; migration.done)
+			return (true);
+
+		CachedStatement copy = statement(copy_query);
+
+		if (!copy.hasResource() || !bind(*copy) || !copy->exec())
+			return (false);
+
+		CachedStatement remove = statement(delete_query);
+
+		return (remove.hasResource() && bind(*remove) && remove->exec());
+	}));
+}
+
+auto Database::migratingSelect(std::string_view table, std::span<const ColumnSchema> columns) -> std::string
+{
+	std::unique_lock lock{_migrations_mutex};
+	auto             it = _migrations.find(table);
+
+	if (it == _migrations.end() || it->second.done)
+		return {};
+
+	Migration& migration = it->second;
+
+	if (!migration.keys_copied)
+	{
+		_migrated_cv.wait(lock, [&migration]() { return (migration.done); });
+		return {};
+	}
+
+	std::vector<std::string> fields;
+
+	for (const ColumnSchema& column : columns)
+	{
+		if (std::ranges::any_of(migration.old_columns, [&column](const std::string& c) { return (iequals(c, column.name)); }))
+			fields.emplace_back(column.name);
+		else
+			fields.emplace_back("NULL");
+	}
+	return (fmt::format("SELECT {} FROM {}__old", fmt::join(fields, ", "), table));
+}
+
+void Database::waitMigration(std::string_view table)
+{
+	std::unique_lock lock{_migrations_mutex};
+	auto             it = _migrations.find(table);
+
+	if (it == _migrations.end())
+		return;
+	_migrated_cv.wait(lock, [&it]() { return (it->second.done); });
+}
+
+bool Database::_hasTable(std::string_view table)
+{
+	CachedStatement stmt  = statement("SELECT COUNT(*) FROM sqlite_schema WHERE type = 'table' AND name = ?");
+	int64           count = 0;
+
+	if (!stmt.hasResource() || !stmt->bind(table))
+		return (false);
+	stmt->exec([&count](DatabaseStatement& row)
+	{
+		count = row.fetchInt64(0);
+		return (true);
+	});
+	return (count != 0);
+}
+
+bool Database::_hasRows(std::string_view table)
+{
+	CachedStatement stmt = statement(fmt::format("SELECT EXISTS (SELECT 1 FROM {})", table));
+	int64           rows = 0;
+
+	if (!stmt.hasResource())
+		return (false);
+	stmt->exec([&rows](DatabaseStatement& row)
+	{
+		rows = row.fetchInt64(0);
+		return (true);
+	});
+	return (rows != 0);
+}
+
+bool Database::_startMigration(const TableSchema& schema, size_t chunk_rows)
+{
+	std::string               old_table = fmt::format("{}__old", schema.name);
+	std::vector<table_column> existing;
+	CachedStatement           info = statement(fmt::format("PRAGMA table_info({})", old_table));
+	std::vector<std::string>  columns;
+	bool                      keys_copied = true;
+
+	if (!info.hasResource())
+		return (false);
+	info->exec([&existing](DatabaseStatement& row)
+	{
+		existing.push_back({std::string{row.fetchText(1)}, std::string{row.fetchText(2)}, row.fetchInt64(5) != 0});
+		return (true);
+	});
+	for (const ColumnSchema& column : schema.columns)
+	{
+		if (std::ranges::any_of(existing, [&column](const table_column& c) { return (iequals(c.name, column.name)); }))
+			columns.emplace_back(column.name);
+		else if (column.primary_key)
+			keys_copied = false;
+	}
+
+	std::string  column_list = fmt::format("{}", fmt::join(columns, ", "));
+	std::jthread previous;
+
+	// a finished rebuild of the table may still be about to take the lock to signal it, it is joined without it
+	{
+		std::unique_lock lock{_migrations_mutex};
+
+		if (auto it = _migrations.find(schema.name); it != _migrations.end())
+			previous = std::move(it->second.thread);
+	}
+	if (previous.joinable())
+		previous.join();
+
+	std::unique_lock lock{_migrations_mutex};
+	Migration&       migration = _migrations[std::string{schema.name}];
+
+	// rows written to the new table since the rebuild started are newer than the old ones
+	// rows breaking a NOT NULL or UNIQUE constraint the table did not have are skipped too
+	migration.copy_query   = fmt::format("INSERT OR IGNORE INTO {0} ({2}) SELECT {2} FROM {1}", schema.name, old_table, column_list);
+	migration.delete_query = fmt::format("DELETE FROM {}", old_table);
+	migration.keys_copied  = keys_copied;
+	migration.done         = false;
+	migration.old_columns.clear();
+	for (const table_column& column : existing)
+		migration.old_columns.push_back(column.name);
+	migration.thread       = std::jthread{[this, table = std::string{schema.name}, m = &migration, chunk_rows](std::stop_token stop) {
+		_runMigration(std::move(table), m, chunk_rows, stop);
+	}};
+	return (true);
+}
+
+void Database::_runMigration(std::string table, Migration* migration, size_t chunk_rows, std::stop_token stop)
+{
+	std::string old_table = fmt::format("{}__old", table);
+	std::string chunk     = fmt::format(" WHERE rowid IN (SELECT rowid FROM {} ORDER BY rowid LIMIT {})", old_table, chunk_rows);
+	size_t      chunks    = 0;
+	bool        finished  = false;
+
+	while (!stop.stop_requested())
+	{
+		bool more = false;
+
+		// moved rows leave the old table, a restart only has the rest to move
+		// like every write on the main connection, a chunk never runs inside the transaction of another thread
+		if (!transaction([&]()
+		{
+			if (!exec(migration->copy_query + chunk) || !exec(migration->delete_query + chunk))
+				return (false);
+			more = _hasRows(old_table);
+			return (true);
+		}))
+		{
+			B12::log(B12::LogLevel::ERROR, "{}: rebuild of table {} failed, it will be tried again on the next start", _name, table);
+			break;
+		}
+		++chunks;
+		if (!more)
+		{
+			finished = transaction([&]()
+			{
+				if (!exec(fmt::format("DROP TABLE {}", old_table)))
+					return (false);
+
+				std::unique_lock lock{_migrations_mutex};
+
+				migration->done = true;
+				return (true);
+			});
+			break;
+		}
+		std::this_thread::sleep_for(MIGRATION_PAUSE);
+	}
+	if (finished)
+		B12::log(B12::LogLevel::BASIC, "{}: rebuilt table {} in {} chunks", _name, table, chunks);
+
+	std::unique_lock lock{_migrations_mutex};
+
+	// lookups stop waiting for it either way, rows left in the old table are moved on the next start
+	migration->done = true;
+	_migrated_cv.notify_all();
+}
+
+void Database::_stopMigrations()
+{
+	std::unique_lock lock{_migrations_mutex};
+
+	for (auto& [table, migration] : _migrations)
+		migration.thread.request_stop();
+	lock.unlock();
+	for (auto& [table, migration] : _migrations)
+	{
+		if (migration.thread.joinable())
+			migration.thread.join();
+	}
+}
+
+void Database::setProfiler(ProfilerConfig config)
+{
+	{
+		std::unique_lock lock{_profiler_mutex};
+
+		_profiler_config = config;
+	}
+	_profiling.store(config.enabled, std::memory_order_relaxed);
+	{
+		std::unique_lock lock{_transaction_mutex};
+
+		_traceConnection(_main);
+	}
+	{
+		// readers in use get the hook when they are checked out next
+		std::unique_lock lock{_readers_mutex};
+
+		for (_::database_connection* connection : _idle_readers)
+			_traceConnection(*connection);
+	}
+	if (config.enabled)
+		return;
+
+	// statements that were running lost their hook and will not report their end
+	std::unique_lock lock{_profiler_mutex};
+
+	_statement_starts.clear();
+}
+
+bool Database::isProfiling() const
+{
+	return (_profiling.load(std::memory_order_relaxed));
+}
+
+auto Database::profile() const -> std::vector<QueryProfile>
+{
+	std::vector<QueryProfile> profiles;
+	std::unique_lock          lock{_profiler_mutex};
+
+	profiles.reserve(_profiles.size());
+	for (const auto& [sql, profile] : _profiles)
+		profiles.push_back(profile);
+	lock.unlock();
+	std::ranges::sort(profiles, std::ranges::greater{}, &QueryProfile::total);
+	return (profiles);
+}
+
+void Database::resetProfile()
+{
+	std::unique_lock lock{_profiler_mutex};
+
+	_profiles.clear();
+}
+
+// the hook is only touched while no other thread writes on the connection : the main one under _transaction_mutex, readers while idle
+void Database::_traceConnection(_::database_connection& connection)
+{
+	bool enabled = isProfiling();
+
+	if (!connection.handle.hasResource() || connection.profiled == enabled)
+		return;
+	sqlite3_trace_v2(connection.handle.get(), (enabled ? SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE : 0), (enabled ? &Database::_onTrace : nullptr), this);
+	connection.profiled = enabled;
+}
+
+int Database::_onTrace(unsigned type, void* database, void* statement, void* nanoseconds)
+{
+	auto* self = static_cast<Database*>(database);
+	auto* stmt = static_cast<sqlite3_stmt*>(statement);
+
+	// triggers report their statements too, the run started with the first one
+	if (type == SQLITE_TRACE_STMT)
+	{
+		auto             now = std::chrono::steady_clock::now();
+		std::unique_lock lock{self->_profiler_mutex};
+
+		self->_statement_starts.try_emplace(stmt, now);
+	}
+	else if (type == SQLITE_TRACE_PROFILE)
+	{
+		auto                     now = std::chrono::steady_clock::now();
+		std::chrono::nanoseconds duration{*static_cast<sqlite3_int64*>(nanoseconds)};
+
+		{
+			// sqlite resets and finalizes report the end of a run too, every start is erased here
+			std::unique_lock lock{self->_profiler_mutex};
+
+			if (auto it = self->_statement_starts.find(stmt); it != self->_statement_starts.end())
+			{
+				duration = now - it->second;
+				self->_statement_starts.erase(it);
+			}
+		}
+		if (self->isProfiling())
+			self->_recordProfile(stmt, duration);
+	}
+	return (0);
+}
+
+void Database::_recordProfile(sqlite3_stmt* statement, std::chrono::nanoseconds duration)
+{
+	// counters are reset so that the next run of a cached statement only counts its own work
+	uint64 vm_steps        = static_cast<uint64>(sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_VM_STEP, 1));
+	uint64 full_scan_steps = static_cast<uint64>(sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1));
+	uint64 sorts           = static_cast<uint64>(sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_SORT, 1));
+	uint64 auto_indexes    = static_cast<uint64>(sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_AUTOINDEX, 1));
+	const char*      sql  = sqlite3_sql(statement);
+	std::string_view text = (sql ? sql : "");
+	std::string_view key  = text;
+	std::unique_lock lock{_profiler_mutex};
+	auto             it = _profiles.find(key);
+
+	if (it == _profiles.end())
+	{
+		if (_profiles.size() >= _profiler_config.max_statements)
+			key = OTHER_STATEMENTS;
+		if (it = _profiles.find(key); it == _profiles.end())
+			it = _profiles.emplace(std::string{key}, QueryProfile{.sql = std::string{key}}).first;
+	}
+
+	QueryProfile& profile = it->second;
+
+	++profile.calls;
+	profile.total += duration;
+	profile.max = std::max(profile.max, duration);
+	++profile.histogram[profile_bucket(duration)];
+	profile.vm_steps += vm_steps;
+	profile.full_scan_steps += full_scan_steps;
+	profile.sorts += sorts;
+	profile.auto_indexes += auto_indexes;
+
+	auto slow_query = _profiler_config.slow_query;
+
+	lock.unlock();
+	if (slow_query.count() <= 0 || duration < slow_query)
+		return;
+
+	// the values are still bound when sqlite reports the run
+	char* expanded = sqlite3_expanded_sql(statement);
+
+	B12::log(
+		B12::LogLevel::BASIC,
+		"{}: slow query, {:.3f}ms, {} VM steps, {} full scan steps, {} sorts :\n{}",
+		_name,
+		static_cast<double>(duration.count()) / 1'000'000.0,
+		vm_steps,
+		full_scan_steps,
+		sorts,
+		(expanded ? std::string_view{expanded} : text)
+	);
+	sqlite3_free(expanded);
+}
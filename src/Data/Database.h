@@ -3,8 +3,23 @@
 
 #include "B12.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <span>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <shion/utils/observer_ptr.h>
 #include <shion/utils/owned_resource.h>
 
@@ -37,10 +52,321 @@ namespace B12
 	template <typename T, shion::string_literal Name>
 	class DataStore;
 
+	class Database;
+
+	// resumes a coroutine that awaited a DatabaseTask, on a thread of its choosing
+	using database_resumer = std::function<void(std::coroutine_handle<>)>;
+
+	// a prepared statement borrowed from the cache of a connection, reset and given back on destruction
+	// each handle is used by one thread at a time, threads running the same query get their own
+	class CachedStatement
+	{
+	public:
+		CachedStatement() = default;
+		CachedStatement(const CachedStatement&) = delete;
+		CachedStatement(CachedStatement&& rhs) noexcept;
+		~CachedStatement();
+
+		CachedStatement &operator=(const CachedStatement&) = delete;
+		CachedStatement &operator=(CachedStatement&& rhs) noexcept;
+
+		bool hasResource() const
+		{
+			return (_statement.hasResource());
+		}
+
+		DatabaseStatement &operator*()
+		{
+			return (_statement);
+		}
+
+		DatabaseStatement *operator->()
+		{
+			return (&_statement);
+		}
+
+		using pool = std::vector<DatabaseStatement>;
+
+	private:
+		friend class Database;
+
+		// mutex guards the pool when the connection is shared between threads, it is null otherwise
+		CachedStatement(pool* statements, std::mutex* mutex, DatabaseStatement statement);
+
+		void _recycle();
+
+		pool*             _pool{nullptr};
+		std::mutex*       _mutex{nullptr};
+		DatabaseStatement _statement;
+	};
+
+	namespace _
+	{
+		struct query_hash
+		{
+			using is_transparent = void;
+
+			size_t operator()(std::string_view query) const noexcept
+			{
+				return (std::hash<std::string_view>{}(query));
+			}
+		};
+
+		// the result of a job handed to the executor threads, shared by the job and its task
+		template <typename T>
+		class database_task_state
+		{
+		public:
+			database_task_state() = default;
+
+			explicit database_task_state(database_resumer resumer) :
+				_resumer{std::move(resumer)} {}
+
+			bool ready() const
+			{
+				std::scoped_lock lock{_mutex};
+
+				return (_done);
+			}
+
+			auto wait() -> T&
+			{
+				std::unique_lock lock{_mutex};
+
+				_cv.wait(lock, [this]() { return (_done); });
+				return (*_result);
+			}
+
+			// returns false if the job ran in the meantime, in which case the coroutine must not suspend
+			bool await(std::coroutine_handle<> handle)
+			{
+				std::scoped_lock lock{_mutex};
+
+				if (_done)
+					return (false);
+				_waiter = handle;
+				return (true);
+			}
+
+			void complete(T result)
+			{
+				std::coroutine_handle<> waiter;
+
+				{
+					std::scoped_lock lock{_mutex};
+
+					_result = std::move(result);
+					_done   = true;
+					waiter  = std::exchange(_waiter, nullptr);
+				}
+				_cv.notify_all();
+				if (!waiter)
+					return;
+				if (_resumer)
+					_resumer(waiter);
+				else
+					waiter.resume();
+			}
+
+		private:
+			mutable std::mutex      _mutex;
+			std::condition_variable _cv;
+			std::optional<T>        _result;
+			std::coroutine_handle<> _waiter;
+			database_resumer        _resumer;
+			bool                    _done = false;
+		};
+
+		// a connection and the statements compiled on it, pools are never erased so their address stays valid
+		struct database_connection
+		{
+			shion::utils::owned_resource<sqlite3*, close_database> handle;
+			std::unordered_map<std::string, CachedStatement::pool, query_hash, std::equal_to<>> statements;
+			bool profiled{false}; // whether the profiler hook is installed on the handle
+		};
+	}
+
+	// a read-only connection checked out of the pool of a Database, given back on destruction
+	// statements from it must be destroyed before it ; without reader connections, uses the main one
+	class DatabaseReader
+	{
+	public:
+		DatabaseReader(const DatabaseReader&) = delete;
+		DatabaseReader(DatabaseReader&& rhs) noexcept;
+		~DatabaseReader();
+
+		DatabaseReader &operator=(const DatabaseReader&) = delete;
+		DatabaseReader &operator=(DatabaseReader&&) = delete;
+
+		CachedStatement statement(std::string_view query);
+
+	private:
+		friend class Database;
+
+		DatabaseReader(Database* database, _::database_connection* connection);
+
+		Database*                _database;
+		_::database_connection*  _connection;
+	};
+
+	/*
+	 * the result of a job run by the executor threads of a Database
+	 * get() blocks until the job ran ; in a coroutine, co_await the task instead,
+	 * the coroutine is then resumed once the job ran, without holding a thread in the meantime,
+	 * through the resumer of the database, or on the executor thread without one
+	 * the result is moved out, a task is awaited once
+	 */
+	template <typename T>
+	class DatabaseTask
+	{
+	public:
+		explicit DatabaseTask(std::shared_ptr<_::database_task_state<T>> state) :
+			_state{std::move(state)} {}
+
+		// a task that is already done
+		static auto done(T result) -> DatabaseTask
+		{
+			auto state = std::make_shared<_::database_task_state<T>>();
+
+			state->complete(std::move(result));
+			return (DatabaseTask{std::move(state)});
+		}
+
+		auto get() -> T
+		{
+			return (std::move(_state->wait()));
+		}
+
+		bool await_ready() const
+		{
+			return (_state->ready());
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			return (_state->await(handle));
+		}
+
+		auto await_resume() -> T
+		{
+			return (get());
+		}
+
+	private:
+		std::shared_ptr<_::database_task_state<T>> _state;
+	};
+
+	// pragmas applied when a database is opened, the effective values are logged
+	struct DatabaseTuning
+	{
+		// keywords as in the sqlite documentation, empty keeps the sqlite default
+		std::string journal_mode = "WAL";
+		std::string synchronous  = "NORMAL";
+		std::string temp_store   = "MEMORY";
+
+		int64                     mmap_size  = int64{256} << 20; // bytes, 0 disables memory-mapped I/O
+		int64                     cache_size = -16384;           // pages when positive, KiB when negative
+		std::chrono::milliseconds busy_timeout{5000};
+
+		// read-only connections next to the main one, each used by one thread at a time
+		size_t readers = 4;
+
+		// threads running the jobs of Database::async, 0 runs them right away on the calling thread
+		size_t executors = 2;
+	};
+
+	struct WriteBehindConfig
+	{
+		bool enabled = false;
+
+		// a batch is committed once it holds this many writes, or this long after its first write
+		size_t                    max_batch = 256;
+		std::chrono::milliseconds max_delay{500};
+	};
+
+	// a column as a DataStore declares it
+	struct ColumnSchema
+	{
+		std::string_view name;
+		std::string_view type;
+		bool             primary_key;
+		bool             not_null = false;
+		bool             unique   = false;
+	};
+
+	struct IndexSchema
+	{
+		std::string_view name;    // starts with the name of the table and "__"
+		std::string_view columns; // comma-separated
+	};
+
+	struct TableSchema
+	{
+		std::string_view              name;
+		std::string_view              create_query; // CREATE TABLE IF NOT EXISTS with the whole schema
+		std::span<const ColumnSchema> columns;
+		std::span<const IndexSchema>  indexes;
+	};
+
+	struct ProfilerConfig
+	{
+		bool enabled = false;
+
+		// statements running longer than this are logged with their bound values, 0 disables the log
+		std::chrono::milliseconds slow_query{100};
+
+		// queries built with their values inline would each get a profile, the ones past this limit share one
+		size_t max_statements = 256;
+	};
+
+	// what the profiler recorded of one statement, over every connection
+	struct QueryProfile
+	{
+		// runs under 10us, 100us, 1ms, 10ms, 100ms, 1s, and longer
+		static constexpr size_t BUCKETS = 7;
+
+		std::string                 sql;
+		uint64                      calls{0};
+		std::chrono::nanoseconds    total{0};
+		std::chrono::nanoseconds    max{0};
+		std::array<uint64, BUCKETS> histogram{};
+
+		// sqlite3_stmt_status counters, summed over the runs
+		uint64 vm_steps{0};
+		uint64 full_scan_steps{0};
+		uint64 sorts{0};
+		uint64 auto_indexes{0};
+	};
+
+	// snapshots taken by a background thread while the database stays in use
+	struct BackupConfig
+	{
+		bool enabled = false;
+
+		std::filesystem::path directory = "data/backups";
+		std::chrono::minutes  interval  = std::chrono::hours{6}; // 0 means only on request
+		size_t                keep      = 7;                     // older snapshots are deleted
+
+		// the main connection is only held for one step at a time, the writer gets its turn in between
+		int                       pages_per_step = 256;
+		std::chrono::milliseconds step_delay{10};
+	};
+
 	class Database
 	{
 	public:
-		bool open(std::filesystem::path path);
+		using write_job = std::function<bool()>;
+		using on_commit = std::function<void()>;
+
+		Database() = default;
+		Database(const Database&) = delete;
+		Database(Database&&) = delete;
+		~Database();
+
+		Database &operator=(const Database&) = delete;
+		Database &operator=(Database&&) = delete;
+
+		bool open(std::filesystem::path path, const DatabaseTuning& tuning = {});
 		bool exec(const std::string& query);
 
 		template <query_callback_type T>
@@ -60,13 +386,219 @@ namespace B12
 
 		DatabaseStatement prepare(std::string_view query);
 
+		// prepares the query once, then hands out the compiled statement again
+		CachedStatement statement(std::string_view query);
+
+		// checks out a read-only connection, waits for one if they are all in use
+		// a thread must not hold more than one at a time
+		DatabaseReader reader();
+
+		// held by every write on the main connection, so that none runs inside the open transaction of another thread
+		// exec() and write() take it, statements from statement() that write must be run with it held
+		auto lockWrites() -> std::unique_lock<std::recursive_mutex>
+		{
+			return (std::unique_lock{_transaction_mutex});
+		}
+
+		// runs fn between BEGIN and COMMIT on the main connection, rolls back if it returns false
+		// transactions run one after the other, the batches of the writer thread included ; fn must not start another
+		template <typename Fn>
+		bool transaction(Fn&& fn)
+		{
+			std::unique_lock lock{_transaction_mutex};
+
+			if (!exec("BEGIN"))
+				return (false);
+			if (!std::invoke(std::forward<Fn>(fn)))
+			{
+				exec("ROLLBACK");
+				return (false);
+			}
+			if (!exec("COMMIT"))
+			{
+				exec("ROLLBACK");
+				return (false);
+			}
+			return (true);
+		}
+
+		// runs fn on an executor thread, fn returns the result of the task
+		// jobs still queued when the database closes run before it does
+		template <typename Fn>
+		auto async(Fn&& fn) -> DatabaseTask<std::invoke_result_t<std::decay_t<Fn>&>>
+		{
+			using result_type = std::invoke_result_t<std::decay_t<Fn>&>;
+
+			static_assert(!std::is_void_v<result_type>, "jobs return a result to their task");
+
+			auto state = std::make_shared<_::database_task_state<result_type>>(resumer());
+
+			_post([state, fn = std::forward<Fn>(fn)]() mutable { state->complete(std::invoke(fn)); });
+			return (DatabaseTask<result_type>{std::move(state)});
+		}
+
+		// hands the coroutines awaiting tasks to resumer once their job ran, so they go on outside of the executors
+		// set before tasks are started, tasks keep the resumer they were started with
+		void setResumer(database_resumer resumer);
+		auto resumer() const -> database_resumer;
+
+		// starts or stops the writer thread, stopping it commits what is still queued
+		void setWriteBehind(WriteBehindConfig config);
+		bool isWriteBehind() const;
+
+		// with write-behind, queues a write for the writer thread, which runs it in the transaction of its batch
+		// without, runs it right away ; committed is called once what the job wrote is visible to the readers
+		bool write(write_job job, on_commit committed = {});
+
+		// blocks until every write queued before the call is committed
+		void flush();
+
+		// copies the database into destination while it stays in use, a few pages at a time
+		bool backup(const std::filesystem::path& destination, std::stop_token stop = {});
+
+		// starts or stops the thread taking snapshots into the backup directory
+		void setBackup(BackupConfig config);
+
+		// wakes the backup thread to take a snapshot now, false if backups are disabled
+		bool requestBackup();
+
+		// brings a table to its schema, comparing it to what PRAGMA table_info says of the table
+		// missing columns are added in place ; changed keys, column types or constraints rebuild the table :
+		// the old table is set aside, and its rows are moved to the new one in chunks by a background thread
+		// indexes named after the table that the schema does not declare anymore are dropped
+		bool migrate(const TableSchema& schema, size_t chunk_rows = 4096);
+
+		bool isMigrating(std::string_view table);
+
+		// while a table is rebuilt, moves the rows of the old table matching the WHERE clause first
+		// bind fills the parameters of the clause ; without the key columns in the old table, waits for the rebuild instead
+		bool copyMigrating(std::string_view table, std::string_view where, const std::function<bool(DatabaseStatement&)>& bind);
+
+		// while a table is rebuilt, a SELECT of the columns from the rows of the old table that were not moved yet,
+		// columns the old table does not have read as NULL ; empty once the rebuild is over
+		// without the key columns in the old table, waits for the rebuild instead, its rows get new keys
+		auto migratingSelect(std::string_view table, std::span<const ColumnSchema> columns) -> std::string;
+
+		// blocks until the rebuild of a table is over
+		void waitMigration(std::string_view table);
+
+		// starts or stops timing every statement run on the main and reader connections
+		// disabling keeps what was recorded, resetProfile clears it
+		void setProfiler(ProfilerConfig config);
+		bool isProfiling() const;
+
+		// the recorded statements, those that took the most time in total first
+		auto profile() const -> std::vector<QueryProfile>;
+		void resetProfile();
+
 	private:
+		friend class DatabaseReader;
+
 		using sqlite_callback = int (*)(void*, int, char**, char**);
 
 		bool _query(const std::string& query, sqlite_callback callback, void* user_data);
 
-		shion::utils::owned_resource<sqlite3*, _::close_database> _database;
-		std::string                                               _name;
+		DatabaseStatement _prepare(sqlite3* connection, std::string_view query);
+		CachedStatement   _statement(_::database_connection& connection, std::mutex* mutex, std::string_view query);
+
+		bool _exec(sqlite3* connection, const std::string& query);
+		void _applyTuning(const DatabaseTuning& tuning);
+		void _applyReaderTuning(sqlite3* connection, const DatabaseTuning& tuning);
+		auto _pragma(std::string_view name) -> std::string;
+
+		void _openReaders(const std::filesystem::path& path, const DatabaseTuning& tuning);
+		void _returnReader(_::database_connection* connection);
+
+		void _startExecutors(size_t count);
+		void _stopExecutors();
+		void _runExecutor(std::stop_token stop);
+		void _post(std::function<void()> job);
+
+		void _stopWriter();
+		void _runWriter(std::stop_token stop);
+		struct queued_write
+		{
+			write_job job;
+			on_commit committed;
+		};
+
+		void _commitBatch(std::vector<queued_write>& batch);
+
+		struct Migration
+		{
+			std::string              copy_query;   // INSERT OR IGNORE of the common columns from the old table
+			std::string              delete_query; // DELETE from the old table
+			std::vector<std::string> old_columns;
+			bool                     keys_copied{false};
+			bool                     done{false};
+			std::jthread             thread;
+		};
+
+		bool _migrateTable(const TableSchema& schema, size_t chunk_rows);
+		bool _migrateIndexes(const TableSchema& schema);
+		auto _ownIndexes(std::string_view table) -> std::vector<std::string>;
+		auto _uniqueColumns(std::string_view table) -> std::vector<std::string>;
+		bool _hasTable(std::string_view table);
+		bool _hasRows(std::string_view table);
+		bool _startMigration(const TableSchema& schema, size_t chunk_rows);
+		void _runMigration(std::string table, Migration* migration, size_t chunk_rows, std::stop_token stop);
+		void _stopMigrations();
+
+		static int _onTrace(unsigned type, void* database, void* statement, void* nanoseconds);
+
+		void _traceConnection(_::database_connection& connection);
+		void _recordProfile(sqlite3_stmt* statement, std::chrono::nanoseconds duration);
+
+		auto _openSnapshot() -> sqlite3*;
+		void _stopBackups();
+		void _runBackups(std::stop_token stop);
+		bool _snapshot(std::stop_token stop);
+		void _rotateBackups();
+
+		_::database_connection _main;
+		std::mutex             _statements_mutex; // guards the statements of the main connection
+		std::recursive_mutex   _transaction_mutex; // taken again by the writes of a transaction
+		std::string            _name;
+		std::filesystem::path  _path;
+
+		std::vector<std::unique_ptr<_::database_connection>> _readers;
+		std::vector<_::database_connection*>                 _idle_readers;
+		std::mutex                                           _readers_mutex;
+		std::condition_variable                              _readers_cv;
+
+		std::deque<std::function<void()>> _jobs;
+		bool                              _async{false}; // whether executors take jobs
+		database_resumer                  _resumer;
+		mutable std::mutex                _jobs_mutex;
+		std::condition_variable_any       _jobs_cv;
+		std::vector<std::jthread>         _executors;
+
+		WriteBehindConfig           _write_config;
+		bool                        _write_behind{false};
+		std::vector<queued_write>   _write_queue;
+		uint64                      _write_queued{0};
+		uint64                      _write_committed{0};
+		bool                        _flush_requested{false};
+		mutable std::mutex          _write_mutex;
+		std::condition_variable_any _write_cv;
+		std::condition_variable_any _flushed_cv;
+		std::jthread                _writer;
+
+		BackupConfig                _backup_config;
+		bool                        _backup_requested{false};
+		std::mutex                  _backup_mutex;
+		std::condition_variable_any _backup_cv;
+		std::jthread                _backup_thread;
+
+		std::unordered_map<std::string, Migration, _::query_hash, std::equal_to<>> _migrations;
+		std::mutex                                                                 _migrations_mutex;
+		std::condition_variable                                                    _migrated_cv;
+
+		ProfilerConfig                                                                  _profiler_config;
+		std::atomic<bool>                                                               _profiling{false};
+		std::unordered_map<std::string, QueryProfile, _::query_hash, std::equal_to<>> _profiles;
+		mutable std::mutex                                                              _profiler_mutex;
+		std::unordered_map<sqlite3_stmt*, std::chrono::steady_clock::time_point>        _statement_starts; // sqlite only times statements to the millisecond
 	};
 } // namespace B12
 
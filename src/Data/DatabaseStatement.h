@@ -6,8 +6,10 @@
 #include <codecvt>
 #include <concepts>
 #include <locale>
-#include <variant>
+#include <optional>
 #include <span>
+#include <string_view>
+#include <variant>
 
 #include <shion/utils/owned_resource.h>
 
@@ -29,8 +31,192 @@ namespace B12
 		};
 
 		using statement_resource = shion::utils::owned_resource<sqlite3_stmt*, free_statement>;
+
+		template <typename T>
+		constexpr inline bool is_optional = false;
+
+		template <typename T>
+		constexpr inline bool is_optional<std::optional<T>> = true;
 	} // namespace _
 
+	// the current row of a statement
+	// text and blob views point into sqlite's memory, they stay valid until the statement steps again or is reset
+	class DatabaseRow
+	{
+	public:
+		explicit DatabaseRow(sqlite3_stmt* statement) :
+			_statement{statement} {}
+
+		int columns() const
+		{
+			return (sqlite3_column_count(_statement));
+		}
+
+		bool isNull(int column) const
+		{
+			return (sqlite3_column_type(_statement, column) == SQLITE_NULL);
+		}
+
+		std::string_view text(int column) const
+		{
+			// the text is asked for before its size, so the size is the one of the text
+			auto* data = reinterpret_cast<const char*>(sqlite3_column_text(_statement, column));
+			int   size = sqlite3_column_bytes(_statement, column);
+
+			if (!data)
+				return {};
+			return {data, static_cast<size_t>(size)};
+		}
+
+		std::span<const std::byte> bytes(int column) const
+		{
+			auto* data = static_cast<const std::byte*>(sqlite3_column_blob(_statement, column));
+			int   size = sqlite3_column_bytes(_statement, column);
+
+			if (!data)
+				return {};
+			return {data, static_cast<size_t>(size)};
+		}
+
+		template <typename T>
+		T get(int column) const
+		{
+			using type = std::remove_cvref_t<T>;
+
+			if constexpr (_::is_optional<type>)
+			{
+				if (isNull(column))
+					return {std::nullopt};
+				return {get<typename type::value_type>(column)};
+			}
+			else if constexpr (std::same_as<type, bool>)
+				return (sqlite3_column_int64(_statement, column) != 0);
+			else if constexpr (std::same_as<type, dpp::snowflake>)
+				return (dpp::snowflake{static_cast<uint64>(sqlite3_column_int64(_statement, column))});
+			else if constexpr (std::integral<type> || std::is_enum_v<type>)
+				return (static_cast<type>(sqlite3_column_int64(_statement, column)));
+			else if constexpr (std::floating_point<type>)
+				return (static_cast<type>(sqlite3_column_double(_statement, column)));
+			else if constexpr (std::same_as<type, std::string_view>)
+				return (text(column));
+			else if constexpr (std::same_as<type, std::string>)
+				return (std::string{text(column)});
+			else if constexpr (std::same_as<type, std::span<const std::byte>>)
+				return (bytes(column));
+			else
+				static_assert(!std::same_as<type, type>, "unsupported column type");
+		}
+
+		// decodes the row into an aggregate, one column per field in declaration order
+		template <typename T>
+		T as() const
+		{
+			return (_as<T>(std::make_index_sequence<boost::pfr::tuple_size_v<T>>()));
+		}
+
+	private:
+		template <typename T, size_t... N>
+		T _as(std::index_sequence<N...>) const
+		{
+			T value{};
+
+			((boost::pfr::get<N>(value) = get<boost::pfr::tuple_element_t<N, T>>(static_cast<int>(N))), ...);
+			return (value);
+		}
+
+		sqlite3_stmt* _statement;
+	};
+
+	// input range over the rows of a statement, each step runs the statement further
+	// T is DatabaseRow, or an aggregate each row is decoded into
+	template <typename T>
+	class DatabaseRows
+	{
+	public:
+		struct sentinel {};
+
+		class iterator
+		{
+		public:
+			using value_type      = T;
+			using difference_type = std::ptrdiff_t;
+
+			T operator*() const
+			{
+				if constexpr (std::same_as<T, DatabaseRow>)
+					return (DatabaseRow{_rows->_statement});
+				else
+					return (DatabaseRow{_rows->_statement}.template as<T>());
+			}
+
+			iterator& operator++()
+			{
+				_rows->_step();
+				return (*this);
+			}
+
+			void operator++(int)
+			{
+				_rows->_step();
+			}
+
+			bool operator==(sentinel) const
+			{
+				return (!_rows->_has_row);
+			}
+
+		private:
+			friend class DatabaseRows;
+
+			explicit iterator(DatabaseRows* rows) :
+				_rows{rows} {}
+
+			DatabaseRows* _rows;
+		};
+
+		explicit DatabaseRows(sqlite3_stmt* statement) :
+			_statement{statement} {}
+
+		iterator begin()
+		{
+			_step();
+			return (iterator{this});
+		}
+
+		sentinel end() const
+		{
+			return {};
+		}
+
+		// true once every row was read, false before or if the statement failed
+		bool done() const
+		{
+			return (_done);
+		}
+
+	private:
+		void _step()
+		{
+			int ret = sqlite3_step(_statement);
+
+			_has_row = (ret == SQLITE_ROW);
+			_done    = (ret == SQLITE_DONE);
+			if (!_has_row && !_done)
+			{
+				B12::log(
+					B12::LogLevel::ERROR,
+					"failed to execute statement :\n"
+					"Message: {}",
+					sqlite3_errstr(ret)
+				);
+			}
+		}
+
+		sqlite3_stmt* _statement;
+		bool          _has_row{false};
+		bool          _done{false};
+	};
+
 	struct DatabaseStatement : public _::statement_resource
 	{
 		using base = _::statement_resource;
@@ -96,6 +282,13 @@ namespace B12
 			));
 		}
 
+		// the rows of the statement, as DatabaseRow or decoded into an aggregate
+		template <typename T = DatabaseRow>
+		DatabaseRows<T> rows()
+		{
+			return (DatabaseRows<T>{base::resource});
+		}
+
 		using variant =
 		std::variant<std::monostate, std::span<const std::byte>, std::string, int64, double>;
 
@@ -197,6 +390,14 @@ namespace B12
 			return (fetchValue(index++));
 		}
 
+		// makes the statement ready to be bound and run again
+		void reset()
+		{
+			sqlite3_reset(base::resource);
+			sqlite3_clear_bindings(base::resource);
+			index = 0;
+		}
+
 		using base::base;
 		using base::operator=;
 
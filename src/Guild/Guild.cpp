@@ -73,16 +73,22 @@ namespace
 }
 
 Guild::Guild(dpp::snowflake id) :
-	_settings{DataStores::guild_settings.get(id)}
+	_id{id}
 {
 	loadGuildSettings();
 }
 
+// reads a copy, an entry held by the guild would pin its row in memory for as long as the guild lives
 void Guild::loadGuildSettings()
 {
-	auto studyChannelID = _settings.get<"study_channel">().value;
-	auto studyRoleID    = _settings.get<"study_role">().value;
-	/*auto studyMessageID = _settings.get<"study_react_message">().value;*/
+	std::optional<GuildSettingsEntry> settings = DataStores::guild_settings[_id];
+
+	if (!settings)
+		return;
+
+	dpp::snowflake studyChannelID = settings->get<"study_channel">();
+	dpp::snowflake studyRoleID    = settings->get<"study_role">();
+	/*dpp::snowflake studyMessageID = settings->get<"study_react_message">();*/
 
 	if (studyRoleID)
 		_studyRole = studyRoleID;
@@ -94,29 +100,17 @@ void Guild::loadGuildSettings()
 void Guild::studyRole(const dpp::role* role)
 {
 	if (role)
-	{
-		_studyRole                    = role->id;
-		_settings.get<"study_role">() = role->id;
-	}
+		_studyRole = role->id;
 	else
-	{
-		_studyRole                    = std::nullopt;
-		_settings.get<"study_role">() = 0;
-	}
+		_studyRole = std::nullopt;
 }
 
 void Guild::studyChannel(const dpp::channel* channel)
 {
 	if (channel)
-	{
-		_studyChannel                    = channel->id;
-		_settings.get<"study_channel">() = channel->id;
-	}
+		_studyChannel = channel->id;
 	else
-	{
-		_studyChannel                    = std::nullopt;
-		_settings.get<"study_channel">() = 0;
-	}
+		_studyChannel = std::nullopt;
 }
 
 dpp::permission Guild::getPermissions(
@@ -129,9 +123,14 @@ dpp::permission Guild::getPermissions(
 
 void Guild::studyMessage(dpp::snowflake) {}
 
-bool Guild::saveSettings()
+auto Guild::saveSettings() -> DatabaseTask<bool>
 {
-	return (DataStores::guild_settings.save(_settings));
+	// the entry only lives for the save, the row can be evicted again once it is written
+	auto settings = DataStores::guild_settings.get(_id);
+
+	settings.get<"study_role">()    = _studyRole.value_or(dpp::snowflake{0});
+	settings.get<"study_channel">() = _studyChannel.value_or(dpp::snowflake{0});
+	return (DataStores::guild_settings.saveAsync(settings));
 }
 
 auto Guild::studyChannel() const -> const std::optional<dpp::snowflake>&
@@ -144,9 +143,9 @@ auto Guild::studyRole() const -> const std::optional<dpp::snowflake>&
 	return (_studyRole);
 }
 
-auto Guild::settings() const -> const DataStores::GuildSettings::Entry&
+auto Guild::settings() const -> std::optional<GuildSettingsEntry>
 {
-	return (_settings);
+	return (DataStores::guild_settings[_id]);
 }
 
 auto Guild::b12Member() const -> const dpp::guild_member&
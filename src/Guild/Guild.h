@@ -22,14 +22,16 @@ namespace B12
 		void studyChannel(const dpp::channel* channel);
 		void studyMessage(dpp::snowflake id);
 
-		const DataStores::GuildSettings::Entry &settings() const;
+		std::optional<GuildSettingsEntry>      settings() const;
 		const std::optional<dpp::snowflake> &        studyRole() const;
 		const std::optional<dpp::snowflake> &     studyChannel() const;
 		const dpp::guild_member &               b12Member() const;
 		const dpp::guild &                      dppGuild() const;
 
 		void loadGuildSettings();
-		bool saveSettings();
+
+		// writes the study role and channel set above, on the executors of the database ; co_await it or get() it
+		DatabaseTask<bool> saveSettings();
 
 		dpp::permission getPermissions(
 			const dpp::guild_member& user,
@@ -52,12 +54,12 @@ namespace B12
 
 		bool _handleActionButton(const dpp::button_click_t& event);
 
+		dpp::snowflake                                   _id;
 		dpp::guild                                       _guild;
 		dpp::guild_member                                _me;
 		std::optional<dpp::snowflake>                         _studyRole{};
 		std::optional<dpp::snowflake>                      _studyChannel{};
 		std::optional<dpp::snowflake>                      _studyMessage{};
-		DataStores::GuildSettings::Entry                 _settings;
 		std::mutex                                       _mutex;
 	};
 } // namespace B12
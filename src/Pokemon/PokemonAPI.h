@@ -4,6 +4,7 @@
 #include "B12.h"
 
 #include "../API/APICache.h"
+#include "../API/ResourcePrefetcher.h"
 
 #include "API/API.h"
 
@@ -12,18 +13,33 @@ namespace B12
 	using PokemonResource = APIResource<"pokemon", uint16>;
 	using PokemonSpeciesResource = APIResource<"pokemon-species", uint16>;
 
-	template <>
-	constexpr inline auto resource_name<PokemonResource> = [](const json &resource) -> std::string_view
+	constexpr inline auto pokeapi_name = [](const json &resource) -> std::string_view
 	{
-	  return (resource["name"].get<std::string_view>());
+		if (auto it = resource.find("name"); it != resource.end() && it->is_string())
+			return (it->get_ref<const std::string &>());
+		return {};
 	};
 
-	template <>
-	constexpr inline auto resource_name<PokemonSpeciesResource> = [](const json &resource) -> std::string_view
+	template <std::integral ID>
+	constexpr inline auto pokeapi_id = [](const json &resource) -> std::optional<ID>
 	{
-	  return (resource["name"].get<std::string_view>());
+		if (auto it = resource.find("id"); it != resource.end() && it->is_number_unsigned())
+			return {it->get<ID>()};
+		return {std::nullopt};
 	};
 
+	template <>
+	constexpr inline auto resource_name<PokemonResource> = pokeapi_name;
+
+	template <>
+	constexpr inline auto resource_name<PokemonSpeciesResource> = pokeapi_name;
+
+	template <>
+	constexpr inline auto resource_id<PokemonResource> = pokeapi_id<uint16>;
+
+	template <>
+	constexpr inline auto resource_id<PokemonSpeciesResource> = pokeapi_id<uint16>;
+
 	struct PokeAPI : API<"pokeapi", "https://pokeapi.co/api/v2/">
 	{
 		Endpoint<PokemonResource, true> pokemon_endpoint{};
@@ -37,15 +53,20 @@ namespace B12
 
 	struct PokeAPICache : APICache<PokeAPI>
 	{
-		PokeAPICache(dpp::cluster *cluster) :
-			pokemon_cache{cluster},
-			pokemon_species_cache{cluster}
+		PokeAPICache(dpp::cluster *cluster, ResourceCacheConfig config = {}, PrefetchConfig prefetch_config = {}) :
+			pokemon_cache{cluster, config},
+			pokemon_species_cache{cluster, config},
+			prefetcher{cluster, prefetch_config}
 		{
-			
+			prefetcher.add(pokemon_cache);
+			prefetcher.add(pokemon_species_cache);
 		}
 		
 		cache_for<POKE_API.pokemon_endpoint> pokemon_cache;
 		cache_for<POKE_API.pokemon_species_endpoint> pokemon_species_cache;
+
+		// declared last, it must stop before the caches are destroyed
+		ResourcePrefetcher prefetcher;
 	};
 }
 
@@ -6,73 +6,99 @@
 
 #include "API/APICache.h"
 
+#include "Commands/commands.h"
+
+#include "../Data/Lang.h"
+
+#include <charconv>
 #include <regex>
 
 using namespace B12;
 
-/*template <>
-CommandResponse CommandHandler::command<"pokemon dex">(
-	command_option_view options
-)
+namespace
 {
-	static constexpr auto error = "Please provide a valid pokemon name or national number."sv;
-	std::string api_param;
-	
-	for (const auto &opt : options)
+	auto string_at(const json &value, std::string_view pointer) -> std::string
 	{
-		if (opt.type == dpp::co_string && opt.name == "name-or-number")
+		json::json_pointer ptr{std::string{pointer}};
+
+		if (value.contains(ptr))
 		{
-			auto truncated = std::get<std::string>(opt.value) | std::views::drop_while(is_whitespace);
-			api_param = {truncated.begin(), truncated.end()};
+			if (const json &found = value[ptr]; found.is_string())
+				return (found.get<std::string>());
 		}
+		return {};
 	}
-	if (api_param.empty() || !std::regex_match(api_param.begin(), api_param.end(), std::regex{"([0-9a-zA-Z\xC3\x80-\xC3\x96\xC3\x98-\xC3\xB6\xC3\xB8-\xC9\x8F-])+", std::regex_constants::extended}))
-		return {CommandResponse::UsageError{}, {std::string{error}}};
-
-	std::string url = POKE_API.pokemon_endpoint.url(api_param);
-	CommandResponse response{CommandResponse::InternalError{}};
-	
-	_source.sendThink(false);
-	_source.thinking_executor.wait();
-	auto entry = Bot::pokemon_cache->pokemon_cache.request(_getInteraction().event.from->creator, std::stoull(api_param));
-
-	std::shared_ptr<PokemonResource> wee = entry.get();
-
-	if (!wee)
-		return {response};
-	
-	auto species_entry = Bot::pokemon_cache->pokemon_species_cache.request(_getInteraction().event.from->creator, std::stoull(api_param));
-	auto species = species_entry.get();
-	
+}
+
+dpp::coroutine<command::response> command::pokemon_dex(dpp::interaction_create_t const &event, const std::string &name_or_number)
+{
+	static constexpr auto error = "Please provide a valid pokemon name or national number."sv;
+	static const std::regex pattern{"[0-9a-zA-Z\xC3\x80-\xC3\x96\xC3\x98-\xC3\xB6\xC3\xB8-\xC9\x8F -]+", std::regex_constants::extended};
+
+	std::string api_param = NameIndex::normalize(name_or_number);
+
+	if (api_param.empty() || !std::regex_match(api_param, pattern))
+		co_return {response::usage_error(error)};
+
+	dpp::cluster *cluster = event.from->creator;
+	PokeAPICache &caches = *Bot::pokemon_cache;
+	auto thinking = event.co_thinking();
+	uint16 number;
+	std::shared_ptr<PokemonResource> pokemon;
+
+	// cache misses suspend this coroutine until the API answers, they do not hold a thread
+	if (auto [end, err] = std::from_chars(api_param.data(), api_param.data() + api_param.size(), number);
+	    err == std::errc{} && end == api_param.data() + api_param.size())
+		pokemon = co_await caches.pokemon_cache.request(cluster, number);
+	else
+		pokemon = co_await caches.pokemon_cache.request(cluster, api_param);
+	if (!pokemon)
+	{
+		std::string message = fmt::format("{} Could not find pokemon {}.", lang::ERROR_EMOJI, api_param);
+		auto suggestions = caches.pokemon_cache.suggest(api_param, 3);
+
+		for (size_t i = 0; i < suggestions.size(); ++i)
+			message += fmt::format("{}{}", (i == 0 ? " Did you mean: "sv : ", "sv), suggestions[i].name);
+		co_await thinking;
+		co_return command::response::edit(message);
+	}
+
+	// resources are shared between threads, read them without operator[] which may insert
+	const json &data = pokemon->resource;
+	std::string species_name = string_at(data, "/species/name");
+	std::shared_ptr<PokemonSpeciesResource> species;
+
+	if (!species_name.empty())
+		species = co_await caches.pokemon_species_cache.request(cluster, species_name);
+	co_await thinking;
 	if (!species)
-		return {response};
-	
-	dpp::message foo;
+		co_return command::response::edit(response::internal_error());
+
 	dpp::embed embed;
-	const nlohmann::json &json = wee->resource;
-	auto name = std::string{json["name"]};
-	auto sprites = json["sprites"];
+	std::string name = string_at(data, "/name");
+	std::string generation = string_at(species->resource, "/generation/name");
 
-	to_upper(name[0]);
-	embed.set_image(json["sprites"]["other"]["official-artwork"]["front_default"]);
+	if (!name.empty())
+		to_upper(name[0]);
+	embed.set_image(string_at(data, "/sprites/other/official-artwork/front_default"));
 	embed.set_url(fmt::format("https://bulbapedia.bulbagarden.net/wiki/{}_(Pok%C3%A9mon)", name));
 	embed.set_title(name);
-	std::string generation = species->resource["generation"]["name"];
-	to_upper(generation[0]);
+	if (!generation.empty())
+		to_upper(generation[0]);
 	for (char &c : generation | std::views::drop_while([](char c){return (c != '-');}) | std::views::drop(1))
 		to_upper(c);
 	embed.set_footer(dpp::embed_footer{generation});
-	if (const auto &bwsprite = sprites["versions"]["generation-v"]["black-white"]["animated"]["front_default"]; !bwsprite.is_null())
+	if (std::string bwsprite = string_at(data, "/sprites/versions/generation-v/black-white/animated/front_default"); !bwsprite.empty())
 		embed.set_thumbnail(bwsprite);
 	else
-		embed.set_thumbnail(sprites["front_default"]);
-	for (const auto &s : json["stats"])
+		embed.set_thumbnail(string_at(data, "/sprites/front_default"));
+	if (auto stats = data.find("stats"); stats != data.end() && stats->is_array())
 	{
-		std::string stat = s["stat"]["name"];
-		embed.add_field(stat, fmt::format("{}", s["base_stat"].get<int>(), true));
+		for (const json &s : *stats)
+		{
+			if (std::string stat = string_at(s, "/stat/name"); !stat.empty() && s.contains("base_stat") && s["base_stat"].is_number_integer())
+				embed.add_field(stat, fmt::format("{}", s["base_stat"].get<int>()), true);
+		}
 	}
-	foo.embeds.push_back(std::move(embed));
-	response = {CommandResponse::Success{}, {std::move(foo)}};
-	return {response};
+	co_return command::response::edit(dpp::message{}.add_embed(embed));
 }
-*/
@@ -0,0 +1,18 @@
+#include "B12.h"
+
+#include "API/APICache.h"
+
+// the APIs of the bot all have IDs that fit 16 bits, this target keeps the wide key path of ResourceCache compiling
+namespace B12
+{
+	namespace
+	{
+		struct WideKeyAPI : API<"wide-keys", "https://localhost/">
+		{
+		};
+
+		using WideKeyResource = APIResource<"resources", dpp::snowflake>;
+	}
+
+	template struct ResourceCache<WideKeyAPI::Endpoint<WideKeyResource, true>>;
+}
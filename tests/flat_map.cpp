@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+
+#include <shion/containers/flat_map.h>
+
+namespace
+{
+	using shion::types::uint64;
+
+	int failures = 0;
+
+	#define CHECK(expr) check((expr), #expr, __LINE__)
+
+	void check(bool success, const char *expr, int line)
+	{
+		if (success)
+			return;
+		std::fprintf(stderr, "flat_map.cpp:%d: check failed: %s\n", line, expr);
+		++failures;
+	}
+
+	// every key lands in the same home slot, so every erase has to shift the rest of the cluster back
+	struct CollidingHash
+	{
+		size_t operator()(uint64 /*key*/) const noexcept
+		{
+			return (0);
+		}
+	};
+
+	// few distinct homes, clusters run into each other and wrap around the end of the table
+	struct ClusteringHash
+	{
+		size_t operator()(uint64 key) const noexcept
+		{
+			return (key % 4);
+		}
+	};
+
+	template <typename Map>
+	bool matches(const Map& map, const std::unordered_map<uint64, int>& reference)
+	{
+		size_t count = 0;
+
+		if (map.size() != reference.size())
+			return (false);
+		for (size_t slot = 0; slot < map.capacity(); ++slot)
+		{
+			if (!map.occupied(slot))
+				continue;
+
+			auto it = reference.find(map.key_at(slot));
+
+			if (it == reference.end() || it->second != map.value_at(slot))
+				return (false);
+			++count;
+		}
+		if (count != reference.size())
+			return (false);
+		for (const auto& [key, value] : reference)
+		{
+			const int *found = map.find(key);
+
+			if (!found || *found != value)
+				return (false);
+		}
+		return (true);
+	}
+
+	void testBackwardShift()
+	{
+		shion::flat_map<uint64, int, CollidingHash> map;
+		std::unordered_map<uint64, int>             reference;
+
+		for (uint64 key = 1; key <= 10; ++key)
+		{
+			*map.try_emplace(key).first = static_cast<int>(key);
+			reference[key] = static_cast<int>(key);
+		}
+		CHECK(matches(map, reference));
+
+		// erasing from the middle, the head and the tail of the probe sequence
+		for (uint64 key : {5, 1, 10, 6, 2})
+		{
+			CHECK(map.erase(key));
+			CHECK(!map.erase(key));
+			reference.erase(key);
+			CHECK(map.find(key) == nullptr);
+			CHECK(matches(map, reference));
+		}
+
+		// the holes are reused without duplicating keys still in the map
+		auto [value, inserted] = map.try_emplace(3);
+
+		CHECK(!inserted);
+		CHECK(*value == 3);
+		CHECK(map.try_emplace(5).second);
+		reference[5] = 0;
+		CHECK(matches(map, reference));
+	}
+
+	template <typename Hash>
+	void testAgainstUnorderedMap(uint64 key_range, int operations)
+	{
+		shion::flat_map<uint64, int, Hash> map;
+		std::unordered_map<uint64, int>    reference;
+		std::mt19937_64                    rng{42};
+
+		for (int i = 0; i < operations; ++i)
+		{
+			uint64 key = rng() % key_range;
+
+			switch (rng() % 3)
+			{
+				case 0:
+				{
+					auto [value, inserted] = map.try_emplace(key);
+
+					CHECK(inserted == !reference.contains(key));
+					*value = i;
+					reference[key] = i;
+					break;
+				}
+
+				case 1:
+					CHECK(map.erase(key) == (reference.erase(key) == 1));
+					break;
+
+				default:
+				{
+					const int *found = map.find(key);
+					auto       it = reference.find(key);
+
+					CHECK((found != nullptr) == (it != reference.end()));
+					if (found && it != reference.end())
+						CHECK(*found == it->second);
+				}
+			}
+			CHECK(map.size() == reference.size());
+		}
+		CHECK(matches(map, reference));
+
+		// erase_at shifts entries back into the slot it frees, which is then visited again
+		for (size_t slot = 0; slot < map.capacity();)
+		{
+			if (!map.occupied(slot))
+			{
+				++slot;
+				continue;
+			}
+			reference.erase(map.key_at(slot));
+			map.erase_at(slot);
+		}
+		CHECK(map.empty());
+		CHECK(reference.empty());
+	}
+}
+
+int main()
+{
+	testBackwardShift();
+	testAgainstUnorderedMap<std::hash<shion::types::uint64>>(5000, 200000);
+	testAgainstUnorderedMap<ClusteringHash>(200, 20000);
+	if (failures)
+	{
+		std::fprintf(stderr, "%d checks failed\n", failures);
+		return (1);
+	}
+	return (0);
+}